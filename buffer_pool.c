@@ -0,0 +1,258 @@
+/**
+ * @file buffer_pool.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Pool of aligned row and band buffers reused across photos and threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "buffer_pool.h"
+
+#define MIN_CLASS 6         // smallest buffers, 64 bytes
+#define MAX_CLASS 22        // largest pooled buffers, 4 MiB, larger ones go straight to the system
+#define CLASSES (MAX_CLASS - MIN_CLASS + 1)
+#define CACHED_PER_CLASS 8  // buffers a thread keeps before returning them to the depot
+#define DEPOT_PER_CLASS 32  // buffers the depot keeps before returning them to the system
+
+/**
+ * A released buffer, linked through its own memory
+ */
+typedef struct free_buffer
+{
+    struct free_buffer *next;
+} free_buffer;
+
+/**
+ * Buffers released by the calling thread, used without locking
+ */
+static __thread struct
+{
+    free_buffer *lists[CLASSES];
+    int counts[CLASSES];
+    int registered;
+} cache;
+
+/**
+ * Buffers shared by every thread, used when a thread's cache is empty or full
+ */
+static struct
+{
+    pthread_mutex_t lock;
+    free_buffer *lists[CLASSES];
+    int counts[CLASSES];
+} depot = {PTHREAD_MUTEX_INITIALIZER};
+
+static buffer_pool_stats stats;
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+/****************************************/
+/*************** Helpers ****************/
+/****************************************/
+/**
+ * @brief Size class of a buffer, CLASSES when too large to pool.
+ */
+static int size_class(size_t size)
+{
+    if (size <= (size_t)1 << MIN_CLASS)
+    {
+        return 0;
+    }
+    int bits = 64 - __builtin_clzll((unsigned long long)size - 1);
+    return bits > MAX_CLASS ? CLASSES : bits - MIN_CLASS;
+}
+
+static size_t class_size(int class)
+{
+    return (size_t)1 << (class + MIN_CLASS);
+}
+
+static void push(free_buffer **list, void *buffer)
+{
+    free_buffer *node = buffer;
+    node->next = *list;
+    *list = node;
+}
+
+static void *pop(free_buffer **list)
+{
+    free_buffer *node = *list;
+    if (node != NULL)
+    {
+        *list = node->next;
+    }
+    return node;
+}
+
+static void free_system_buffer(void *buffer, size_t size)
+{
+    __atomic_sub_fetch(&stats.reserved, size, __ATOMIC_RELAXED);
+    free(buffer);
+}
+
+/**
+ * @brief Gives a buffer to the depot, or back to the system once the depot holds enough.
+ * @details Called with the depot locked.
+ */
+static void deposit(int class, void *buffer)
+{
+    if (depot.counts[class] < DEPOT_PER_CLASS)
+    {
+        push(&depot.lists[class], buffer);
+        depot.counts[class]++;
+    }
+    else
+    {
+        free_system_buffer(buffer, class_size(class));
+    }
+}
+
+/**
+ * @brief Moves the buffers of an exiting thread to the depot.
+ */
+static void flush_cache(void *unused)
+{
+    pthread_mutex_lock(&depot.lock);
+    for (int c = 0; c < CLASSES; c++)
+    {
+        void *buffer;
+        while ((buffer = pop(&cache.lists[c])) != NULL)
+        {
+            deposit(c, buffer);
+        }
+        cache.counts[c] = 0;
+    }
+    pthread_mutex_unlock(&depot.lock);
+}
+
+static void create_cache_key(void)
+{
+    pthread_key_create(&cache_key, flush_cache);
+}
+
+static void count_use(size_t size)
+{
+    size_t in_use = __atomic_add_fetch(&stats.in_use, size, __ATOMIC_RELAXED);
+    size_t high_water = __atomic_load_n(&stats.high_water, __ATOMIC_RELAXED);
+    while (in_use > high_water &&
+           !__atomic_compare_exchange_n(&stats.high_water, &high_water, in_use, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+static void *system_buffer(size_t size)
+{
+    void *buffer = aligned_alloc(BUFFER_ALIGNMENT, size);
+    if (buffer != NULL)
+    {
+        __atomic_add_fetch(&stats.reserved, size, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stats.system_allocations, 1, __ATOMIC_RELAXED);
+    }
+    return buffer;
+}
+
+/****************************************/
+/************* Buffer Pool **************/
+/****************************************/
+void *acquire_buffer(size_t size)
+{
+    int class = size_class(size);
+
+    // Too large to pool
+    if (class == CLASSES)
+    {
+        size = (size + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+        void *buffer = system_buffer(size);
+        if (buffer != NULL)
+        {
+            count_use(size);
+        }
+        return buffer;
+    }
+
+    // The thread's own cache, then the depot, then the system
+    void *buffer = pop(&cache.lists[class]);
+    if (buffer != NULL)
+    {
+        cache.counts[class]--;
+    }
+    else
+    {
+        pthread_mutex_lock(&depot.lock);
+        buffer = pop(&depot.lists[class]);
+        depot.counts[class] -= buffer != NULL;
+        pthread_mutex_unlock(&depot.lock);
+
+        if (buffer == NULL)
+        {
+            buffer = system_buffer(class_size(class));
+        }
+    }
+
+    if (buffer != NULL)
+    {
+        count_use(class_size(class));
+    }
+    return buffer;
+}
+
+void release_buffer(void *buffer, size_t size)
+{
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    int class = size_class(size);
+    if (class == CLASSES)
+    {
+        size = (size + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+        __atomic_sub_fetch(&stats.in_use, size, __ATOMIC_RELAXED);
+        free_system_buffer(buffer, size);
+        return;
+    }
+    __atomic_sub_fetch(&stats.in_use, class_size(class), __ATOMIC_RELAXED);
+
+    // Flush the cache to the depot when the thread exits
+    if (!cache.registered)
+    {
+        pthread_once(&cache_key_once, create_cache_key);
+        pthread_setspecific(cache_key, &cache);
+        cache.registered = 1;
+    }
+
+    if (cache.counts[class] < CACHED_PER_CLASS)
+    {
+        push(&cache.lists[class], buffer);
+        cache.counts[class]++;
+    }
+    else
+    {
+        pthread_mutex_lock(&depot.lock);
+        deposit(class, buffer);
+        pthread_mutex_unlock(&depot.lock);
+    }
+}
+
+buffer_pool_stats get_buffer_pool_stats(void)
+{
+    buffer_pool_stats current;
+    current.in_use = __atomic_load_n(&stats.in_use, __ATOMIC_RELAXED);
+    current.high_water = __atomic_load_n(&stats.high_water, __ATOMIC_RELAXED);
+    current.reserved = __atomic_load_n(&stats.reserved, __ATOMIC_RELAXED);
+    current.system_allocations = __atomic_load_n(&stats.system_allocations, __ATOMIC_RELAXED);
+    return current;
+}
+
+void display_buffer_pool_stats(void)
+{
+    buffer_pool_stats current = get_buffer_pool_stats();
+    fprintf(stdout, "=== Buffer Pool ===\n");
+    fprintf(stdout, "In use: %zu bytes\n", current.in_use);
+    fprintf(stdout, "High-water mark: %zu bytes\n", current.high_water);
+    fprintf(stdout, "Reserved: %zu bytes\n", current.reserved);
+    fprintf(stdout, "System allocations: %lu\n", current.system_allocations);
+}
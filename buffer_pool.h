@@ -0,0 +1,54 @@
+/**
+ * @file buffer_pool.h
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Pool of aligned row and band buffers reused across photos and threads.
+ */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+#define BUFFER_ALIGNMENT 64
+
+/**
+ * Memory held by the pool
+ */
+typedef struct
+{
+    size_t in_use;                    // bytes handed out and not yet released
+    size_t high_water;                // most bytes ever handed out at once
+    size_t reserved;                  // bytes allocated from the system
+    unsigned long system_allocations; // buffers allocated from the system
+} buffer_pool_stats;
+
+/**
+ * @brief Takes a buffer of at least size bytes aligned to BUFFER_ALIGNMENT.
+ * @details Buffers are grouped into power of two size classes up to 4 MiB. A buffer released
+ *          by the calling thread is reused without locking, and the system is only asked
+ *          for memory when no released buffer of the class is left. Larger buffers are not
+ *          pooled, so whole photos should be allocated from the system directly.
+ * @param size Number of bytes needed.
+ * @return Returns the buffer, with unspecified contents, or NULL when out of memory.
+ */
+void *acquire_buffer(size_t size);
+/**
+ * @brief Returns a buffer to the pool for reuse.
+ * @details Buffers too large to pool, or beyond what the pool keeps of their class, are freed.
+ * @param buffer Buffer from acquire_buffer, or NULL.
+ * @param size The size passed to acquire_buffer.
+ */
+void release_buffer(void *buffer, size_t size);
+/**
+ * @brief Memory held by the pool.
+ * @return Returns the current use, high-water mark, and system memory of the pool.
+ */
+buffer_pool_stats get_buffer_pool_stats(void);
+/**
+ * @brief Displays the memory held by the pool.
+ */
+void display_buffer_pool_stats(void);
+
+#endif
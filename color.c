@@ -0,0 +1,404 @@
+/**
+ * @file color.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Color space conversions and color adjustments of bmp photos.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "color.h"
+#include "planar.h"
+#include "parallel.h"
+#include "buffer_pool.h"
+
+#define YCBCR_BITS 14 // fraction bits of the coefficients of the YCbCr transforms
+
+/**
+ * Adjustment of every pixel of a photo
+ */
+typedef struct
+{
+    bmp_file bmp;
+    color_matrix matrix;
+} adjust_job;
+
+/****************************************/
+/**************** Tables ****************/
+/****************************************/
+static double linear[256];     // linearize() of each color
+static double thresholds[256]; // smallest linear color delinearize() maps to each color
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Fills the tables so linear colors map to the same colors as delinearize().
+ */
+static void build_tables(void)
+{
+    for (int v = 0; v < 256; v++)
+    {
+        linear[v] = linearize(v);
+    }
+
+    // Bisect the ordered bit patterns of positive doubles for each step of delinearize()
+    thresholds[0] = 0;
+    for (int v = 1; v < 256; v++)
+    {
+        double low_value = 0, high_value = 1;
+        unsigned long long low, high;
+        memcpy(&low, &low_value, sizeof(low));
+        memcpy(&high, &high_value, sizeof(high));
+        while (high - low > 1)
+        {
+            unsigned long long middle = low + (high - low) / 2;
+            double color_lin;
+            memcpy(&color_lin, &middle, sizeof(color_lin));
+            if (delinearize(color_lin) >= v)
+            {
+                high = middle;
+            }
+            else
+            {
+                low = middle;
+            }
+        }
+        memcpy(&thresholds[v], &high, sizeof(thresholds[v]));
+
+        // The bisection never tests 1 itself, colors past delinearize(1) are never reached
+        if (delinearize(thresholds[v]) < v)
+        {
+            thresholds[v] = INFINITY;
+        }
+    }
+}
+
+/**
+ * @brief Largest color whose table entry the linear color reaches.
+ */
+static uint8_t search_table(const double table[256], double color_lin)
+{
+    int color = 0;
+    for (int step = 128; step > 0; step >>= 1)
+    {
+        if (table[color + step] <= color_lin)
+        {
+            color += step;
+        }
+    }
+    return color;
+}
+
+void prepare_color_tables(void)
+{
+    pthread_once(&tables_once, build_tables);
+}
+
+const double *linear_colors(void)
+{
+    prepare_color_tables();
+    return linear;
+}
+
+uint8_t table_delinearize(double color_lin)
+{
+    return search_table(thresholds, color_lin);
+}
+
+/****************************************/
+/************** Transforms **************/
+/****************************************/
+static const int rgb_channels[3] = {CHANNEL_RED, CHANNEL_GREEN, CHANNEL_BLUE};
+
+/**
+ * @brief Rounds a transform given in red, green, blue order to fixed point.
+ */
+static color_matrix fixed_matrix(const double transform[3][3], int bits)
+{
+    color_matrix matrix = {.bits = bits};
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            double coefficient = round(transform[i][j] * (1 << bits));
+            coefficient = coefficient > INT16_MAX ? INT16_MAX : coefficient < INT16_MIN ? INT16_MIN : coefficient;
+            matrix.m[rgb_channels[i]][rgb_channels[j]] = coefficient;
+        }
+    }
+    return matrix;
+}
+
+/**
+ * @brief Multiplies two transforms, the result applies second after first.
+ */
+static void multiply_transforms(const double second[3][3], const double first[3][3], double result[3][3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            result[i][j] = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                result[i][j] += second[i][k] * first[k][j];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Clamps a saturation or brightness factor.
+ */
+static double clamp_factor(double factor)
+{
+    return factor < 0 ? 0 : factor > MAX_COLOR_FACTOR ? MAX_COLOR_FACTOR : factor;
+}
+
+/**
+ * @brief Rotation of hues about the gray axis, weighted by luminance.
+ */
+static void hue_transform(double degrees, double transform[3][3])
+{
+    double c = cos(degrees * M_PI / 180), s = sin(degrees * M_PI / 180);
+    double rotation[3][3] = {
+        {0.213 + c * 0.787 - s * 0.213, 0.715 - c * 0.715 - s * 0.715, 0.072 - c * 0.072 + s * 0.928},
+        {0.213 - c * 0.213 + s * 0.143, 0.715 + c * 0.285 + s * 0.140, 0.072 - c * 0.072 - s * 0.283},
+        {0.213 - c * 0.213 - s * 0.787, 0.715 - c * 0.715 + s * 0.715, 0.072 + c * 0.928 + s * 0.072},
+    };
+    memcpy(transform, rotation, sizeof(rotation));
+}
+
+/**
+ * @brief Scaling of the distance of each color from its gray.
+ */
+static void saturation_transform(double factor, double transform[3][3])
+{
+    double f = clamp_factor(factor);
+    double scaling[3][3] = {
+        {0.213 + 0.787 * f, 0.715 - 0.715 * f, 0.072 - 0.072 * f},
+        {0.213 - 0.213 * f, 0.715 + 0.285 * f, 0.072 - 0.072 * f},
+        {0.213 - 0.213 * f, 0.715 - 0.715 * f, 0.072 + 0.928 * f},
+    };
+    memcpy(transform, scaling, sizeof(scaling));
+}
+
+/**
+ * @brief Scaling of every channel.
+ */
+static void brightness_transform(double factor, double transform[3][3])
+{
+    double f = clamp_factor(factor);
+    double scaling[3][3] = {{f, 0, 0}, {0, f, 0}, {0, 0, f}};
+    memcpy(transform, scaling, sizeof(scaling));
+}
+
+color_matrix ycbcr_matrix(void)
+{
+    const double transform[3][3] = {
+        {0.299, 0.587, 0.114},
+        {-0.168736, -0.331264, 0.5},
+        {0.5, -0.418688, -0.081312},
+    };
+    color_matrix matrix = fixed_matrix(transform, YCBCR_BITS);
+    matrix.out_offset[CHANNEL_GREEN] = matrix.out_offset[CHANNEL_BLUE] = 128;
+    return matrix;
+}
+
+color_matrix rgb_matrix(void)
+{
+    const double transform[3][3] = {
+        {1, 0, 1.402},
+        {1, -0.344136, -0.714136},
+        {1, 1.772, 0},
+    };
+    color_matrix matrix = fixed_matrix(transform, YCBCR_BITS);
+    matrix.in_offset[CHANNEL_GREEN] = matrix.in_offset[CHANNEL_BLUE] = 128;
+    return matrix;
+}
+
+color_matrix hue_matrix(double degrees)
+{
+    double transform[3][3];
+    hue_transform(degrees, transform);
+    return fixed_matrix(transform, ADJUST_BITS);
+}
+
+color_matrix saturation_matrix(double factor)
+{
+    double transform[3][3];
+    saturation_transform(factor, transform);
+    return fixed_matrix(transform, ADJUST_BITS);
+}
+
+color_matrix brightness_matrix(double factor)
+{
+    double transform[3][3];
+    brightness_transform(factor, transform);
+    return fixed_matrix(transform, ADJUST_BITS);
+}
+
+/**
+ * @brief Transforms the channels of one pixel.
+ */
+static void transform_pixel(const color_matrix *matrix, const int in[CHANNELS], int out[CHANNELS])
+{
+    for (int k = 0; k < CHANNELS; k++)
+    {
+        int sum = 1 << (matrix->bits - 1);
+        for (int c = 0; c < CHANNELS; c++)
+        {
+            sum += matrix->m[k][c] * (in[c] - matrix->in_offset[c]);
+        }
+        int value = (sum >> matrix->bits) + matrix->out_offset[k];
+        out[k] = value < 0 ? 0 : value > 255 ? 255 : value;
+    }
+}
+
+#ifdef __SSE2__
+/**
+ * @brief Sums one output channel of 4 pixels.
+ * @details Each 32 bit lane holds a pixel's blue and green, then red and 1, so
+ *          pmaddwd sums the products with the coefficients and the rounding.
+ */
+static inline __m128i transform_sums(__m128i blue_green, __m128i red_one, __m128i pairs[2], __m128i shift, __m128i offset)
+{
+    __m128i sums = _mm_add_epi32(_mm_madd_epi16(blue_green, pairs[0]), _mm_madd_epi16(red_one, pairs[1]));
+    return _mm_add_epi32(_mm_sra_epi32(sums, shift), offset);
+}
+#endif
+
+void transform_row(const color_matrix *matrix, unsigned char *planes[CHANNELS], int width)
+{
+    int w = 0;
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+    __m128i shift = _mm_cvtsi32_si128(matrix->bits);
+    __m128i one = _mm_set1_epi16(1);
+    __m128i pairs[CHANNELS][2], in_offset[CHANNELS], out_offset[CHANNELS];
+    for (int k = 0; k < CHANNELS; k++)
+    {
+        uint16_t rounding = 1 << (matrix->bits - 1);
+        pairs[k][0] = _mm_set1_epi32((uint16_t)matrix->m[k][CHANNEL_BLUE] | (uint32_t)(uint16_t)matrix->m[k][CHANNEL_GREEN] << 16);
+        pairs[k][1] = _mm_set1_epi32((uint16_t)matrix->m[k][CHANNEL_RED] | (uint32_t)rounding << 16);
+        in_offset[k] = _mm_set1_epi16(matrix->in_offset[k]);
+        out_offset[k] = _mm_set1_epi32(matrix->out_offset[k]);
+    }
+
+    for (; w + 8 <= width; w += 8)
+    {
+        __m128i in[CHANNELS];
+        for (int c = 0; c < CHANNELS; c++)
+        {
+            in[c] = _mm_loadl_epi64((const __m128i *)(planes[c] + w));
+            in[c] = _mm_sub_epi16(_mm_unpacklo_epi8(in[c], zero), in_offset[c]);
+        }
+        __m128i blue_green_low = _mm_unpacklo_epi16(in[CHANNEL_BLUE], in[CHANNEL_GREEN]);
+        __m128i blue_green_high = _mm_unpackhi_epi16(in[CHANNEL_BLUE], in[CHANNEL_GREEN]);
+        __m128i red_one_low = _mm_unpacklo_epi16(in[CHANNEL_RED], one);
+        __m128i red_one_high = _mm_unpackhi_epi16(in[CHANNEL_RED], one);
+
+        // Every output needs every input, so store only once all are computed
+        __m128i out[CHANNELS];
+        for (int k = 0; k < CHANNELS; k++)
+        {
+            __m128i low = transform_sums(blue_green_low, red_one_low, pairs[k], shift, out_offset[k]);
+            __m128i high = transform_sums(blue_green_high, red_one_high, pairs[k], shift, out_offset[k]);
+            out[k] = _mm_packs_epi32(low, high);
+            out[k] = _mm_packus_epi16(out[k], out[k]);
+        }
+        for (int k = 0; k < CHANNELS; k++)
+        {
+            _mm_storel_epi64((__m128i *)(planes[k] + w), out[k]);
+        }
+    }
+#endif
+    for (; w < width; w++)
+    {
+        int in[CHANNELS], out[CHANNELS];
+        for (int c = 0; c < CHANNELS; c++)
+        {
+            in[c] = planes[c][w];
+        }
+        transform_pixel(matrix, in, out);
+        for (int k = 0; k < CHANNELS; k++)
+        {
+            planes[k][w] = out[k];
+        }
+    }
+}
+
+/****************************************/
+/************** Adjust BMP **************/
+/****************************************/
+static void adjust_band(void *context, int band, int start, int end)
+{
+    adjust_job *job = context;
+    int width = job->bmp.header.dib.width;
+    int stride = row_stride(job->bmp.header);
+    int rows = band_rows(stride);
+
+    // One row of planes at a time keeps the conversions in cache
+    size_t colors_size = (size_t)rows * stride, plane_size = plane_stride(width);
+    unsigned char *colors = acquire_buffer(colors_size);
+    unsigned char *planes[CHANNELS];
+    int reserved = colors != NULL;
+    for (int p = 0; p < CHANNELS; p++)
+    {
+        reserved &= (planes[p] = acquire_buffer(plane_size)) != NULL;
+    }
+    if (!reserved)
+    {
+        fprintf(stderr, "Not enough memory to adjust rows %i to %i.\n", start, end - 1);
+    }
+
+    for (int h = start; h < end && reserved; h += rows)
+    {
+        int count = end - h < rows ? end - h : rows;
+        read_rows(job->bmp, h, count, colors);
+        for (int r = 0; r < count; r++)
+        {
+            unsigned char *row = colors + (size_t)r * stride;
+            deinterleave_row(row, planes, width);
+            transform_row(&job->matrix, planes, width);
+            interleave_row(planes, row, width);
+        }
+        write_rows(job->bmp, h, count, colors);
+    }
+
+    release_buffer(colors, colors_size);
+    for (int p = 0; p < CHANNELS; p++)
+    {
+        release_buffer(planes[p], plane_size);
+    }
+}
+
+void adjust_colors(bmp_file bmp, double degrees, double saturation, double brightness)
+{
+    if (!validate_bpp(bmp.header.dib.bpp))
+    {
+        fprintf(stdout, "Photo colors were not adjusted.\n");
+        return;
+    }
+    if (saturation < 0 || saturation > MAX_COLOR_FACTOR || brightness < 0 || brightness > MAX_COLOR_FACTOR)
+    {
+        fprintf(stderr, "Saturation and brightness must be from 0 to %.0f.\n", MAX_COLOR_FACTOR);
+        fprintf(stdout, "Photo colors were not adjusted.\n");
+        return;
+    }
+
+    // Combine the adjustments so each pixel is transformed once
+    double hue[3][3], saturate[3][3], brighten[3][3], combined[3][3], transform[3][3];
+    hue_transform(degrees, hue);
+    saturation_transform(saturation, saturate);
+    brightness_transform(brightness, brighten);
+    multiply_transforms(saturate, hue, combined);
+    multiply_transforms(brighten, combined, transform);
+
+    adjust_job job = {bmp, fixed_matrix(transform, ADJUST_BITS)};
+    parallel_rows(bmp.header.dib.height, adjust_band, &job);
+}
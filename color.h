@@ -0,0 +1,98 @@
+/**
+ * @file color.h
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Color space conversions and color adjustments of bmp photos.
+ */
+
+#ifndef COLOR_H
+#define COLOR_H
+
+#include "stenography.h"
+
+#define ADJUST_BITS 10       // fraction bits of the coefficients of an adjustment
+#define MAX_COLOR_FACTOR 4.0 // largest saturation or brightness factor
+
+/**
+ * Fixed point affine transform of the channels of a pixel, rounding to nearest:
+ * out[k] = (sum over c of m[k][c] * (in[c] - in_offset[c]) >> bits) + out_offset[k], clamped to 0..255
+ */
+typedef struct
+{
+    int16_t m[CHANNELS][CHANNELS]; // indexed by output channel, then input channel
+    int16_t in_offset[CHANNELS];
+    int16_t out_offset[CHANNELS];
+    int bits;
+} color_matrix;
+
+/*****************/
+/***** Tables ****/
+/*****************/
+/**
+ * @brief Builds the linearization tables ahead of their first use.
+ */
+void prepare_color_tables(void);
+/**
+ * @brief linearize() of every color.
+ * @return Returns a table of 256 linear colors.
+ */
+const double *linear_colors(void);
+/**
+ * @brief Delinearizes by table, matching delinearize() for linear colors from 0 to 1.
+ * @details Needs the tables built by prepare_color_tables() or linear_colors() first,
+ *          so loops over pixels pay no check.
+ * @param color_lin A linear color from 0 to 1.
+ * @return Returns the same color as delinearize(), 254 at most.
+ */
+uint8_t table_delinearize(double color_lin);
+
+/*****************/
+/*** Transforms **/
+/*****************/
+/**
+ * @brief Transform from colors to YCbCr, storing Y in the red plane, Cb in the green plane, and Cr in the blue plane.
+ */
+color_matrix ycbcr_matrix(void);
+/**
+ * @brief Transform from YCbCr, stored as by ycbcr_matrix(), back to colors.
+ */
+color_matrix rgb_matrix(void);
+/**
+ * @brief Adjustment rotating hues around the gray axis, keeping luminance.
+ * @param degrees Angle of the rotation, red toward green for positive angles.
+ */
+color_matrix hue_matrix(double degrees);
+/**
+ * @brief Adjustment scaling the distance of each color from its gray, keeping luminance.
+ * @param factor 0 for gray, 1 for no change, from 0 to MAX_COLOR_FACTOR.
+ */
+color_matrix saturation_matrix(double factor);
+/**
+ * @brief Adjustment scaling each channel.
+ * @param factor 0 for black, 1 for no change, from 0 to MAX_COLOR_FACTOR.
+ */
+color_matrix brightness_matrix(double factor);
+/**
+ * @brief Transforms a row of planar pixels in place.
+ * @details Uses SSE2 for 8 pixels at a time when available, matching the scalar path exactly.
+ * @param matrix The transform.
+ * @param planes Rows of each plane, indexed by channel.
+ * @param width Number of pixels in the row.
+ */
+void transform_row(const color_matrix *matrix, unsigned char *planes[CHANNELS], int width);
+
+/*****************/
+/*** Alter BMP ***/
+/*****************/
+/**
+ * @brief Rotates the hue, then scales the saturation and brightness of a photo in one pass.
+ * @details The three adjustments are combined into a single transform of each pixel.
+ * @param bmp A bmp photo to adjust.
+ * @param degrees Hue rotation in degrees.
+ * @param saturation Saturation factor, from 0 to MAX_COLOR_FACTOR.
+ * @param brightness Brightness factor, from 0 to MAX_COLOR_FACTOR.
+ */
+void adjust_colors(bmp_file bmp, double degrees, double saturation, double brightness);
+
+#endif
@@ -0,0 +1,220 @@
+/**
+ * @file composite.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Blending and compositing of two bmp photos.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "composite.h"
+#include "parallel.h"
+#include "buffer_pool.h"
+
+#define OPACITY_BITS 8 // fixed-point precision of the opacity
+
+/**
+ * Two photos streamed together in bands of rows
+ */
+typedef struct
+{
+    bmp_file target, source;
+    enum blend_mode mode;
+    int opacity;                  // fixed-point, 1 << OPACITY_BITS is opaque
+    int first_row, source_row;    // first target row and source row overlapping
+    int offset, source_offset;    // byte offsets into target and source rows
+    int length;                   // bytes blended per row
+} blend_job;
+
+/****************************************/
+/*************** Helpers ****************/
+/****************************************/
+/**
+ * @brief Scalar blend of a single color, matching the vector blend bit for bit.
+ */
+static uint8_t blend_color(uint8_t target, uint8_t source, enum blend_mode mode, int opacity)
+{
+    uint16_t blended;
+    switch (mode)
+    {
+    case BLEND_ADD:
+        blended = target + source > 255 ? 255 : target + source;
+        break;
+    case BLEND_MULTIPLY:
+        blended = target * source + 128;
+        blended = (blended + (blended >> 8)) >> 8; // divide by 255, rounded
+        break;
+    case BLEND_DIFFERENCE:
+        blended = target > source ? target - source : source - target;
+        break;
+    default:
+        blended = source;
+        break;
+    }
+
+    // mix the target and blended colors by the opacity, fits in 16 bits
+    uint16_t mixed = target * ((1 << OPACITY_BITS) - opacity) + blended * opacity + (1 << (OPACITY_BITS - 1));
+    return mixed >> OPACITY_BITS;
+}
+
+#ifdef __SSE2__
+/**
+ * @brief Blends 8 colors widened to 16 bits.
+ */
+static __m128i blend_vector(__m128i target, __m128i source, enum blend_mode mode, __m128i opacity, __m128i transparency)
+{
+    const __m128i half = _mm_set1_epi16(1 << (OPACITY_BITS - 1));
+    __m128i blended;
+    switch (mode)
+    {
+    case BLEND_ADD:
+        blended = _mm_min_epi16(_mm_add_epi16(target, source), _mm_set1_epi16(255));
+        break;
+    case BLEND_MULTIPLY:
+        blended = _mm_add_epi16(_mm_mullo_epi16(target, source), _mm_set1_epi16(128));
+        blended = _mm_srli_epi16(_mm_add_epi16(blended, _mm_srli_epi16(blended, 8)), 8);
+        break;
+    case BLEND_DIFFERENCE:
+        blended = _mm_or_si128(_mm_subs_epu16(target, source), _mm_subs_epu16(source, target));
+        break;
+    default:
+        blended = source;
+        break;
+    }
+
+    __m128i mixed = _mm_add_epi16(_mm_mullo_epi16(target, transparency), _mm_mullo_epi16(blended, opacity));
+    return _mm_srli_epi16(_mm_add_epi16(mixed, half), OPACITY_BITS);
+}
+#endif
+
+/**
+ * @brief Blends a run of source colors into a run of target colors.
+ */
+static void blend_colors(unsigned char *restrict target, const unsigned char *restrict source, int n, enum blend_mode mode, int opacity)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weight = _mm_set1_epi16(opacity);
+    const __m128i inverse = _mm_set1_epi16((1 << OPACITY_BITS) - opacity);
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i t = _mm_loadu_si128((const __m128i *)(target + i));
+        __m128i s = _mm_loadu_si128((const __m128i *)(source + i));
+        __m128i low = blend_vector(_mm_unpacklo_epi8(t, zero), _mm_unpacklo_epi8(s, zero), mode, weight, inverse);
+        __m128i high = blend_vector(_mm_unpackhi_epi8(t, zero), _mm_unpackhi_epi8(s, zero), mode, weight, inverse);
+        _mm_storeu_si128((__m128i *)(target + i), _mm_packus_epi16(low, high));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        target[i] = blend_color(target[i], source[i], mode, opacity);
+    }
+}
+
+/**
+ * @brief Blends the overlapping rows of a band, reading both photos a band at a time.
+ */
+static void blend_band(void *context, int band, int start, int end)
+{
+    blend_job *job = context;
+    int target_stride = row_stride(job->target.header);
+    int source_stride = row_stride(job->source.header);
+    int rows = band_rows(target_stride > source_stride ? target_stride : source_stride);
+
+    size_t target_size = (size_t)rows * target_stride, source_size = (size_t)rows * source_stride;
+    unsigned char *target = acquire_buffer(target_size);
+    unsigned char *source = acquire_buffer(source_size);
+    if (target == NULL || source == NULL)
+    {
+        fprintf(stderr, "Not enough memory to blend rows %i to %i.\n", start, end - 1);
+        release_buffer(target, target_size), release_buffer(source, source_size);
+        return;
+    }
+
+    for (int h = start; h < end; h += rows)
+    {
+        int count = end - h < rows ? end - h : rows;
+        read_rows(job->target, job->first_row + h, count, target);
+        read_rows(job->source, job->source_row + h, count, source);
+
+        for (int r = 0; r < count; r++)
+        {
+            blend_colors(target + (size_t)r * target_stride + job->offset, source + (size_t)r * source_stride + job->source_offset,
+                         job->length, job->mode, job->opacity);
+        }
+
+        write_rows(job->target, job->first_row + h, count, target);
+    }
+
+    release_buffer(target, target_size), release_buffer(source, source_size);
+}
+
+/**
+ * @brief Converts an opacity to fixed-point, clamped from 0 to 1.
+ */
+static int fixed_opacity(double opacity)
+{
+    opacity = opacity < 0 ? 0 : opacity > 1 ? 1 : opacity;
+    return (int)lround(opacity * (1 << OPACITY_BITS));
+}
+
+/****************************************/
+/************** Composite ***************/
+/****************************************/
+void composite(bmp_file target, bmp_file source, enum blend_mode mode, double opacity)
+{
+    // Validate bmp format
+    if (!validate_bpp(target.header.dib.bpp) || !validate_bpp(source.header.dib.bpp))
+    {
+        fprintf(stdout, "Photos were not blended.\n");
+        return;
+    }
+
+    // Make sure same size
+    if (target.header.dib.height != source.header.dib.height ||
+        target.header.dib.width != source.header.dib.width)
+    {
+        fprintf(stderr, "The two photos are not the same size. Images must be the same height and width.\n");
+        fprintf(stdout, "Photos were not blended.\n");
+        return;
+    }
+
+    blend_job job = {target, source, mode, fixed_opacity(opacity), 0, 0, 0, 0, target.header.dib.width * sizeof(rgb)};
+    parallel_rows(target.header.dib.height, blend_band, &job);
+}
+
+void watermark(bmp_file target, bmp_file mark, int x, int y, double opacity)
+{
+    // Validate bmp format
+    if (!validate_bpp(target.header.dib.bpp) || !validate_bpp(mark.header.dib.bpp))
+    {
+        fprintf(stdout, "Photo was not watermarked.\n");
+        return;
+    }
+
+    // Clip the mark to the target, rows are stored from the bottom up
+    int width = target.header.dib.width, height = target.header.dib.height;
+    int mark_width = mark.header.dib.width, mark_height = mark.header.dib.height;
+    int left = x < 0 ? 0 : x;
+    int right = x + mark_width > width ? width : x + mark_width;
+    int bottom = height - y - mark_height;
+    int first = bottom < 0 ? 0 : bottom;
+    int last = height - y > height ? height : height - y;
+    if (left >= right || first >= last)
+    {
+        fprintf(stderr, "The watermark does not overlap the photo.\n");
+        fprintf(stdout, "Photo was not watermarked.\n");
+        return;
+    }
+
+    blend_job job = {target, mark, BLEND_ALPHA, fixed_opacity(opacity), first, first - bottom,
+                     left * sizeof(rgb), (left - x) * sizeof(rgb), (right - left) * sizeof(rgb)};
+    parallel_rows(last - first, blend_band, &job);
+}
@@ -0,0 +1,47 @@
+/**
+ * @file composite.h
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Blending and compositing of two bmp photos.
+ */
+
+#ifndef COMPOSITE_H
+#define COMPOSITE_H
+
+#include "stenography.h"
+
+/**
+ * How the colors of the source photo combine with the colors of the target photo
+ */
+enum blend_mode
+{
+    BLEND_ALPHA,      // the source color
+    BLEND_ADD,        // sum of the colors, saturating at 255
+    BLEND_MULTIPLY,   // product of the colors normalized to 255
+    BLEND_DIFFERENCE, // absolute difference of the colors
+    BLEND_MODES
+};
+
+/**
+ * @brief Blends a source photo into a target photo of the same size.
+ * @details Streams both photos in large bands of rows, mixing each target color
+ *          with the blended color by the opacity.
+ * @param target bmp photo altered by the blend.
+ * @param source bmp photo blended into the target.
+ * @param mode How the colors combine.
+ * @param opacity Weight of the blended color, from 0.0 keeping the target to 1.0.
+ */
+void composite(bmp_file target, bmp_file source, enum blend_mode mode, double opacity);
+/**
+ * @brief Overlays a smaller photo onto a target photo at an offset.
+ * @details The part of the mark outside of the target is ignored.
+ * @param target bmp photo altered by the overlay.
+ * @param mark bmp photo overlaid on the target.
+ * @param x Pixels from the left edge of the target to the left edge of the mark.
+ * @param y Pixels from the top edge of the target to the top edge of the mark.
+ * @param opacity Weight of the mark, from 0.0 to 1.0.
+ */
+void watermark(bmp_file target, bmp_file mark, int x, int y, double opacity);
+
+#endif
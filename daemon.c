@@ -0,0 +1,426 @@
+/**
+ * @file daemon.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Resident service running jobs sent over a Unix domain socket.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "daemon.h"
+#include "stenography.h"
+#include "pipeline.h"
+#include "parallel.h"
+#include "buffer_pool.h"
+
+#define QUEUE_SIZE 256
+#define CONNECTION_THREADS 4 // threads reading requests and running jobs, so a slow client holds only one
+#define REQUEST_SIZE 1024
+#define REPLY_SIZE 256
+#define PATH_SIZE 512
+#define ACCEPT_BACKOFF_NS 100000000 // pause while out of descriptors or memory, before accepting again
+
+/**
+ * A connection waiting for a connection thread
+ */
+typedef struct
+{
+    int client;
+    struct timespec queued;
+} daemon_job;
+
+/**
+ * Connections waiting to be read and the latency of the jobs finished
+ */
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    daemon_job jobs[QUEUE_SIZE];
+    int head, count, max_count;
+    int running;
+    int server; // listening socket, shut down to stop accepting once asked to quit
+    unsigned long completed, failed;
+    double total_us, max_us;
+} queue = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+/****************************************/
+/*************** Helpers ****************/
+/****************************************/
+static double elapsed_us(struct timespec since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since.tv_sec) * 1e6 + (now.tv_nsec - since.tv_nsec) / 1e3;
+}
+
+static void reply(int client, const char *message)
+{
+    send(client, message, strlen(message), MSG_NOSIGNAL);
+}
+
+/**
+ * @brief Reads a line from the client, without its newline.
+ * @return Returns 1 when a line was read, 0 when the client closed or sent too much.
+ */
+static int read_request(int client, char request[REQUEST_SIZE])
+{
+    size_t length = 0;
+    while (length < REQUEST_SIZE - 1)
+    {
+        ssize_t received = recv(client, request + length, REQUEST_SIZE - 1 - length, 0);
+        if (received <= 0)
+        {
+            break;
+        }
+        length += received;
+
+        char *newline = memchr(request, '\n', length);
+        if (newline != NULL)
+        {
+            *newline = '\0';
+            return 1;
+        }
+    }
+
+    request[length] = '\0';
+    return length > 0 && length < REQUEST_SIZE - 1;
+}
+
+/**
+ * @brief Copies the next field of a request, up to a separator or the end of the request.
+ * @return Returns the rest of the request after the separator, or NULL when the field is empty or too long.
+ */
+static const char *next_field(const char *request, char separator, char *field, size_t size)
+{
+    const char *end = strchr(request, separator);
+    size_t length = end != NULL ? (size_t)(end - request) : strlen(request);
+    if (length == 0 || length >= size)
+    {
+        return NULL;
+    }
+
+    memcpy(field, request, length);
+    field[length] = '\0';
+    return end != NULL ? end + 1 : request + length;
+}
+
+/**
+ * @brief Splits a job request into its input, operations, and output.
+ * @details Fields are separated by tabs, so paths may hold spaces. A request without tabs is split at single spaces.
+ * @return Returns 1 when there are exactly three fields, 0 otherwise.
+ */
+static int parse_request(const char *request, char input[PATH_SIZE], char chain[REQUEST_SIZE], char output[PATH_SIZE])
+{
+    char separator = strchr(request, '\t') != NULL ? '\t' : ' ';
+    const char *rest = next_field(request, separator, input, PATH_SIZE);
+    rest = rest != NULL ? next_field(rest, separator, chain, REQUEST_SIZE) : NULL;
+    rest = rest != NULL ? next_field(rest, separator, output, PATH_SIZE) : NULL;
+    return rest != NULL && *rest == '\0';
+}
+
+/**
+ * @brief Runs a job request.
+ * @return Returns 1 when the job ran, 0 with the reason in error otherwise.
+ */
+static int run_job(const char *request, char error[REPLY_SIZE])
+{
+    char input[PATH_SIZE], chain[REQUEST_SIZE], output[PATH_SIZE];
+    pipeline_stage stages[MAX_STAGES];
+    int count = 0;
+
+    if (!parse_request(request, input, chain, output))
+    {
+        snprintf(error, REPLY_SIZE, "expected <input>\\t<operations>\\t<output>");
+        return 0;
+    }
+    if (strcmp(chain, "-") && (count = parse_pipeline(chain, stages)) < 0)
+    {
+        snprintf(error, REPLY_SIZE, "invalid operation or amount in %.200s", chain);
+        return 0;
+    }
+
+    bmp_file source = open_bmp(input);
+    if (source.photo == NULL)
+    {
+        snprintf(error, REPLY_SIZE, "%.200s could not be opened", input);
+        return 0;
+    }
+    if (!validate_bpp(source.header.dib.bpp))
+    {
+        snprintf(error, REPLY_SIZE, "%.200s is not 24 bpp", input);
+        close_bmp(source);
+        return 0;
+    }
+
+    // Process in place, or stream the input into a new output, which would empty an input
+    // reached by another path such as ./photo.bmp or a link
+    if (same_file(source, output))
+    {
+        run_pipeline(source, stages, count);
+    }
+    else
+    {
+        bmp_file destination = create_bmp(output, source.header);
+        if (destination.photo == NULL)
+        {
+            snprintf(error, REPLY_SIZE, "%.200s could not be created", output);
+            close_bmp(source);
+            return 0;
+        }
+        run_pipeline_into(source, destination, stages, count);
+        close_bmp(destination);
+    }
+
+    close_bmp(source);
+    return 1;
+}
+
+/****************************************/
+/***************** Jobs *****************/
+/****************************************/
+/**
+ * @brief Answers a stats request with the queue depth, latency, and buffer memory.
+ */
+static void reply_stats(int client)
+{
+    char message[REPLY_SIZE];
+    buffer_pool_stats pool = get_buffer_pool_stats();
+    pthread_mutex_lock(&queue.lock);
+    unsigned long jobs = queue.completed + queue.failed;
+    snprintf(message, sizeof(message),
+             "queued %i max_queued %i completed %lu failed %lu mean_us %.0f max_us %.0f "
+             "buffer_bytes %zu buffer_high_water %zu buffer_reserved %zu buffer_allocations %lu\n",
+             queue.count, queue.max_count, queue.completed, queue.failed,
+             jobs ? queue.total_us / jobs : 0, queue.max_us,
+             pool.in_use, pool.high_water, pool.reserved, pool.system_allocations);
+    pthread_mutex_unlock(&queue.lock);
+    reply(client, message);
+}
+
+/**
+ * @brief Stops accepting connections, queued connections are still answered.
+ */
+static void stop_accepting(void)
+{
+    pthread_mutex_lock(&queue.lock);
+    queue.running = 0;
+    pthread_cond_broadcast(&queue.ready);
+    pthread_mutex_unlock(&queue.lock);
+
+    // Wakes the accepting thread
+    shutdown(queue.server, SHUT_RDWR);
+}
+
+/**
+ * @brief Reads the request of a connection and answers it.
+ */
+static void serve(daemon_job job)
+{
+    // Give up on clients that stall while sending their request
+    struct timeval timeout = {1, 0};
+    setsockopt(job.client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char request[REQUEST_SIZE];
+    if (!read_request(job.client, request))
+    {
+        reply(job.client, "error expected a single line request\n");
+        return;
+    }
+    if (strcmp(request, "stats") == 0)
+    {
+        reply_stats(job.client);
+        return;
+    }
+    if (strcmp(request, "quit") == 0)
+    {
+        reply(job.client, "ok\n");
+        stop_accepting();
+        return;
+    }
+
+    char message[REPLY_SIZE], error[REPLY_SIZE];
+    int success = run_job(request, error);
+    double latency = elapsed_us(job.queued);
+    if (success)
+    {
+        snprintf(message, sizeof(message), "ok %.0f\n", latency);
+    }
+    else
+    {
+        snprintf(message, sizeof(message), "error %.240s\n", error);
+    }
+    reply(job.client, message);
+
+    pthread_mutex_lock(&queue.lock);
+    queue.completed += success;
+    queue.failed += !success;
+    queue.total_us += latency;
+    queue.max_us = latency > queue.max_us ? latency : queue.max_us;
+    pthread_mutex_unlock(&queue.lock);
+}
+
+static void *connection_thread(void *arg)
+{
+    pthread_mutex_lock(&queue.lock);
+    while (queue.running || queue.count > 0)
+    {
+        if (queue.count == 0)
+        {
+            pthread_cond_wait(&queue.ready, &queue.lock);
+            continue;
+        }
+
+        daemon_job job = queue.jobs[queue.head];
+        queue.head = (queue.head + 1) % QUEUE_SIZE;
+        queue.count--;
+        pthread_mutex_unlock(&queue.lock);
+
+        serve(job);
+        close(job.client);
+
+        pthread_mutex_lock(&queue.lock);
+    }
+    pthread_mutex_unlock(&queue.lock);
+    return NULL;
+}
+
+/**
+ * @brief Queues a connection for the connection threads.
+ * @return Returns 1 when queued, 0 when the queue is full or the daemon is quitting.
+ */
+static int queue_job(int client, struct timespec queued)
+{
+    pthread_mutex_lock(&queue.lock);
+    if (queue.count == QUEUE_SIZE || !queue.running)
+    {
+        pthread_mutex_unlock(&queue.lock);
+        return 0;
+    }
+
+    daemon_job *job = &queue.jobs[(queue.head + queue.count) % QUEUE_SIZE];
+    job->client = client;
+    job->queued = queued;
+    queue.count++;
+    queue.max_count = queue.count > queue.max_count ? queue.count : queue.max_count;
+
+    pthread_cond_signal(&queue.ready);
+    pthread_mutex_unlock(&queue.lock);
+    return 1;
+}
+
+/**
+ * @brief Checks whether the daemon is still accepting connections.
+ */
+static int is_running(void)
+{
+    pthread_mutex_lock(&queue.lock);
+    int running = queue.running;
+    pthread_mutex_unlock(&queue.lock);
+    return running;
+}
+
+/****************************************/
+/**************** Daemon ****************/
+/****************************************/
+int run_daemon(const char *socket_path)
+{
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Socket path %s is too long.\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    // Listen on the socket
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if (server < 0 || bind(server, (struct sockaddr *)&address, sizeof(address)) || listen(server, QUEUE_SIZE))
+    {
+        fprintf(stderr, "Could not listen on %s.\n", socket_path);
+        if (server >= 0)
+        {
+            close(server);
+        }
+        return 1;
+    }
+
+    // Warm the workers and tables shared by every job
+    start_workers();
+    prepare_kernels();
+
+    pthread_t threads[CONNECTION_THREADS];
+    int started = 0;
+    queue.running = 1;
+    queue.server = server;
+    while (started < CONNECTION_THREADS && pthread_create(&threads[started], NULL, connection_thread, NULL) == 0)
+    {
+        started++;
+    }
+    if (started == 0)
+    {
+        fprintf(stderr, "Could not start the connection threads.\n");
+        close(server);
+        unlink(socket_path);
+        return 1;
+    }
+    fprintf(stdout, "Listening on %s.\n", socket_path);
+    fflush(stdout);
+
+    // Only accept here, requests are read by the connection threads
+    int status = 0;
+    while (1)
+    {
+        int client = accept(server, NULL, NULL);
+        if (client < 0)
+        {
+            if (!is_running())
+            {
+                break;
+            }
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+
+            // Wait for connections to close rather than spinning while out of descriptors or memory
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+            {
+                struct timespec backoff = {0, ACCEPT_BACKOFF_NS};
+                nanosleep(&backoff, NULL);
+                continue;
+            }
+            fprintf(stderr, "Could not accept connections on %s.\n", socket_path);
+            stop_accepting();
+            status = 1;
+            break;
+        }
+
+        struct timespec queued;
+        clock_gettime(CLOCK_MONOTONIC, &queued);
+        if (!queue_job(client, queued))
+        {
+            reply(client, is_running() ? "error queue is full\n" : "error daemon is quitting\n");
+            close(client);
+        }
+    }
+
+    // Finish the queued connections
+    for (int t = 0; t < started; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    close(server);
+    unlink(socket_path);
+    return status;
+}
@@ -0,0 +1,31 @@
+/**
+ * @file daemon.h
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Resident service running jobs sent over a Unix domain socket.
+ *
+ * Connections are read and answered by a few connection threads, so a client slow to send its
+ * request holds up only its own thread. Each connection sends one line and receives one line in reply:
+ *  - `<input>\t<operations>\t<output>` runs the operations, such as grayscale,invert, over the input
+ *    photo and writes the output photo. Operations may be `-` to copy the photo. The fields are
+ *    separated by tabs so paths may hold spaces, a line without tabs is split at spaces. Replies
+ *    `ok <microseconds>` with the time from queueing to finishing, or `error <reason>`.
+ *  - `stats` replies with the queue depth, jobs run, their latency, and the memory held for buffers.
+ *  - `quit` stops the service once queued jobs finish.
+ */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+/**
+ * @brief Listens on a Unix domain socket and runs jobs until asked to quit.
+ * @details Worker threads and kernel tables are prepared once and reused by every job.
+ *          An output naming the input photo by any path, or a link to it, is processed in place.
+ * @param socket_path Path of the socket, replaced when it exists.
+ *          Accepting is retried when interrupted, and after a pause when out of descriptors or memory.
+ * @return Returns 0 after quitting, 1 when the socket cannot be opened or accepting fails otherwise.
+ */
+int run_daemon(const char *socket_path);
+
+#endif
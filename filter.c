@@ -0,0 +1,566 @@
+/**
+ * @file filter.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Convolution filters for blurring, sharpening, and detecting edges in a bmp photo.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "filter.h"
+#include "parallel.h"
+#include "buffer_pool.h"
+
+#define MAX_PASSES 2  // separable kernels applied to the same rows
+#define WEIGHT_BITS 7 // fixed-point precision of blur weights, weights sum to 1 << WEIGHT_BITS
+#define AMOUNT_BITS 8 // fixed-point precision of the sharpening amount
+#define BOX_BITS 24   // fixed-point precision of the box blur's reciprocal area
+
+/**
+ * Combines the sums of each pass into the colors of an output row
+ * @param settings Settings of the filter.
+ * @param sums Weighted sums of each pass.
+ * @param original The original colors of the row.
+ * @param out The filtered colors of the row.
+ * @param n Number of colors in the row.
+ */
+typedef void (*combine_row)(const void *settings, int *sums[MAX_PASSES], const unsigned char *original, unsigned char *out, int n);
+
+/**
+ * Kernels applied across each row then down each column
+ */
+typedef struct
+{
+    int passes, radius;
+    int16_t horizontal[MAX_PASSES][2 * MAX_RADIUS + 1];
+    int16_t vertical[MAX_PASSES][2 * MAX_RADIUS + 1];
+    combine_row combine;
+    const void *settings;
+} separable_filter;
+
+/**
+ * A photo streamed through bands of rows.
+ * The rows within radius of each band are read before any band writes,
+ * so each band may write its own rows in place.
+ */
+typedef struct
+{
+    bmp_file bmp;
+    int radius, stride;
+    unsigned char *halos; // 2 * radius rows per band, those below the band then those above
+    size_t halos_size;
+    const separable_filter *filter;
+} band_stream;
+
+/****************************************/
+/*************** Helpers ****************/
+/****************************************/
+static int clamp(int value, int low, int high)
+{
+    return value < low ? low : value > high ? high : value;
+}
+
+/**
+ * @brief Adds the values multiplied by a weight to the sums.
+ */
+static void accumulate(int *restrict sums, const int16_t *restrict values, int16_t weight, int n)
+{
+    int i = 0;
+#ifdef __SSE2__
+    __m128i factor = _mm_set1_epi16(weight);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i value = _mm_loadu_si128((const __m128i *)(values + i));
+        __m128i low = _mm_mullo_epi16(value, factor);
+        __m128i high = _mm_mulhi_epi16(value, factor);
+        __m128i *sum = (__m128i *)(sums + i);
+        _mm_storeu_si128(sum, _mm_add_epi32(_mm_loadu_si128(sum), _mm_unpacklo_epi16(low, high)));
+        _mm_storeu_si128(sum + 1, _mm_add_epi32(_mm_loadu_si128(sum + 1), _mm_unpackhi_epi16(low, high)));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        sums[i] += values[i] * weight;
+    }
+}
+
+/**
+ * @brief Narrows the sums to shorts, saturating those out of range.
+ */
+static void narrow(int16_t *restrict values, const int *restrict sums, int n)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i low = _mm_loadu_si128((const __m128i *)(sums + i));
+        __m128i high = _mm_loadu_si128((const __m128i *)(sums + i + 4));
+        _mm_storeu_si128((__m128i *)(values + i), _mm_packs_epi32(low, high));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        values[i] = clamp(sums[i], -32768, 32767);
+    }
+}
+
+/**
+ * @brief Reads the rows within radius of every band.
+ * @return Returns 1 when read, 0 when out of memory.
+ */
+static int open_stream(bmp_file bmp, int radius, const separable_filter *filter, band_stream *stream)
+{
+    int height = bmp.header.dib.height;
+    int bands = band_count(height);
+
+    *stream = (band_stream){bmp, radius, row_stride(bmp.header), NULL, 0, filter};
+    stream->halos_size = (size_t)bands * 2 * radius * stream->stride;
+    stream->halos = acquire_buffer(stream->halos_size);
+    if (stream->halos == NULL)
+    {
+        fprintf(stderr, "Not enough memory to filter the photo.\n");
+        return 0;
+    }
+
+    for (int b = 0; b < bands; b++)
+    {
+        int start, end;
+        band_bounds(height, b, &start, &end);
+        unsigned char *halo = stream->halos + (size_t)b * 2 * radius * stream->stride;
+
+        // rows below the band fill the last slots of its lower half
+        int below = start - radius < 0 ? 0 : start - radius;
+        if (below < start)
+        {
+            read_rows(bmp, below, start - below, halo + (size_t)(below - start + radius) * stream->stride);
+        }
+
+        // rows above the band fill the first slots of its upper half
+        int above = end + radius > height ? height : end + radius;
+        if (end < above)
+        {
+            read_rows(bmp, end, above - end, halo + (size_t)radius * stream->stride);
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Copies a row of the photo as it was before any band wrote to it.
+ */
+static void stream_row(band_stream *stream, int band, int start, int end, int row, unsigned char *buffer)
+{
+    unsigned char *halo = stream->halos + (size_t)band * 2 * stream->radius * stream->stride;
+
+    if (row < start)
+    {
+        memcpy(buffer, halo + (size_t)(row - start + stream->radius) * stream->stride, stream->stride);
+    }
+    else if (row >= end)
+    {
+        memcpy(buffer, halo + (size_t)(stream->radius + row - end) * stream->stride, stream->stride);
+    }
+    else
+    {
+        read_rows(stream->bmp, row, 1, buffer);
+    }
+}
+
+/****************************************/
+/*********** Separable Filter ***********/
+/****************************************/
+/**
+ * @brief Filters a band of rows, keeping a ring of the last 2 * radius + 1 rows read.
+ */
+static void separable_band(void *context, int band, int start, int end)
+{
+    band_stream *stream = context;
+    const separable_filter *filter = stream->filter;
+    int height = stream->bmp.header.dib.height;
+    int width = stream->bmp.header.dib.width;
+    int n = width * sizeof(rgb);
+    int radius = filter->radius;
+    int ring = 2 * radius + 1;
+
+    // Ring of original and horizontally filtered rows, and scratch rows
+    size_t originals_size = (size_t)ring * stream->stride;
+    size_t filtered_size = sizeof(int16_t) * filter->passes * ring * n;
+    size_t extended_size = sizeof(int16_t) * (n + 2 * radius * sizeof(rgb));
+    size_t sums_size = sizeof(int) * filter->passes * n;
+    unsigned char *originals = acquire_buffer(originals_size);
+    int16_t *filtered = acquire_buffer(filtered_size);
+    int16_t *extended = acquire_buffer(extended_size);
+    int *sums = acquire_buffer(sums_size);
+    unsigned char *out = acquire_buffer(stream->stride);
+    if (originals == NULL || filtered == NULL || extended == NULL || sums == NULL || out == NULL)
+    {
+        fprintf(stderr, "Not enough memory to filter rows %i to %i.\n", start, end - 1);
+        release_buffer(originals, originals_size), release_buffer(filtered, filtered_size);
+        release_buffer(extended, extended_size), release_buffer(sums, sums_size), release_buffer(out, stream->stride);
+        return;
+    }
+    memset(out, 0, stream->stride);
+
+    int *pass_sums[MAX_PASSES];
+    for (int p = 0; p < filter->passes; p++)
+    {
+        pass_sums[p] = sums + p * n;
+    }
+
+    int next = start - radius < 0 ? 0 : start - radius;
+    for (int h = start; h < end; h++)
+    {
+        // Read and horizontally filter the rows up to radius above
+        for (int last = clamp(h + radius, 0, height - 1); next <= last; next++)
+        {
+            int slot = next % ring;
+            unsigned char *original = originals + (size_t)slot * stream->stride;
+            stream_row(stream, band, start, end, next, original);
+
+            // Widen the row, repeating the edge pixels radius times
+            for (int i = 0; i < n; i++)
+            {
+                extended[radius * sizeof(rgb) + i] = original[i];
+            }
+            for (int w = 0; w < radius; w++)
+            {
+                for (int c = 0; c < CHANNELS; c++)
+                {
+                    extended[w * sizeof(rgb) + c] = original[c];
+                    extended[(radius + width + w) * sizeof(rgb) + c] = original[n - sizeof(rgb) + c];
+                }
+            }
+
+            for (int p = 0; p < filter->passes; p++)
+            {
+                memset(pass_sums[p], 0, sizeof(int) * n);
+                for (int k = 0; k < ring; k++)
+                {
+                    if (filter->horizontal[p][k])
+                    {
+                        accumulate(pass_sums[p], extended + k * sizeof(rgb), filter->horizontal[p][k], n);
+                    }
+                }
+                narrow(filtered + ((size_t)p * ring + slot) * n, pass_sums[p], n);
+            }
+        }
+
+        // Vertically filter the ring, repeating the top and bottom rows
+        for (int p = 0; p < filter->passes; p++)
+        {
+            memset(pass_sums[p], 0, sizeof(int) * n);
+            for (int k = 0; k < ring; k++)
+            {
+                if (filter->vertical[p][k])
+                {
+                    int slot = clamp(h + k - radius, 0, height - 1) % ring;
+                    accumulate(pass_sums[p], filtered + ((size_t)p * ring + slot) * n, filter->vertical[p][k], n);
+                }
+            }
+        }
+
+        // Write the filtered row in place
+        filter->combine(filter->settings, pass_sums, originals + (size_t)(h % ring) * stream->stride, out, n);
+        write_rows(stream->bmp, h, 1, out);
+    }
+
+    release_buffer(originals, originals_size), release_buffer(filtered, filtered_size);
+    release_buffer(extended, extended_size), release_buffer(sums, sums_size), release_buffer(out, stream->stride);
+}
+
+/**
+ * @brief Applies a separable filter to every row of the photo.
+ */
+static void run_filter(bmp_file bmp, const separable_filter *filter)
+{
+    band_stream stream;
+    if (!open_stream(bmp, filter->radius, filter, &stream))
+    {
+        fprintf(stdout, "Photo was not filtered.\n");
+        return;
+    }
+
+    parallel_rows(bmp.header.dib.height, separable_band, &stream);
+    release_buffer(stream.halos, stream.halos_size);
+}
+
+static void blur_combine(const void *settings, int *sums[MAX_PASSES], const unsigned char *original, unsigned char *out, int n)
+{
+    const int shift = 2 * WEIGHT_BITS;
+    for (int i = 0; i < n; i++)
+    {
+        out[i] = clamp((sums[0][i] + (1 << (shift - 1))) >> shift, 0, 255);
+    }
+}
+
+static void sharpen_combine(const void *settings, int *sums[MAX_PASSES], const unsigned char *original, unsigned char *out, int n)
+{
+    const int shift = 2 * WEIGHT_BITS;
+    int amount = *(const int *)settings;
+    for (int i = 0; i < n; i++)
+    {
+        int blurred = (sums[0][i] + (1 << (shift - 1))) >> shift;
+        int detail = (original[i] - blurred) * amount;
+        out[i] = clamp(original[i] + ((detail + (1 << (AMOUNT_BITS - 1))) >> AMOUNT_BITS), 0, 255);
+    }
+}
+
+static void edge_combine(const void *settings, int *sums[MAX_PASSES], const unsigned char *original, unsigned char *out, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        // normalized by the weight of the smoothing kernel, 4
+        int magnitude = abs(sums[0][i]) + abs(sums[1][i]);
+        out[i] = clamp(magnitude >> 2, 0, 255);
+    }
+}
+
+/**
+ * @brief Fills a fixed-point gaussian kernel whose weights sum to 1 << WEIGHT_BITS.
+ */
+static void gaussian_kernel(double sigma, int radius, int16_t *weights)
+{
+    double values[2 * MAX_RADIUS + 1];
+    double total = 0;
+    for (int k = -radius; k <= radius; k++)
+    {
+        values[k + radius] = exp(-(k * k) / (2 * sigma * sigma));
+        total += values[k + radius];
+    }
+
+    // round each weight, the center takes the rounding error
+    int sum = 0;
+    for (int k = 0; k < 2 * radius + 1; k++)
+    {
+        weights[k] = (int16_t)lround(values[k] / total * (1 << WEIGHT_BITS));
+        sum += weights[k];
+    }
+    weights[radius] += (1 << WEIGHT_BITS) - sum;
+}
+
+/****************************************/
+/*************** Box Blur ***************/
+/****************************************/
+/**
+ * @brief Running sums across a row of the photo, reading rows up to it into the ring.
+ * @return Returns the sums of the row, repeating the edge pixels.
+ */
+static const uint16_t *box_row(band_stream *stream, int band, int start, int end, int row, int *next,
+                               unsigned char *original, uint16_t *row_sums)
+{
+    int width = stream->bmp.header.dib.width;
+    int n = width * sizeof(rgb);
+    int radius = stream->radius;
+    int ring = 2 * radius + 2; // holds the row leaving the column sums as well
+
+    for (; *next <= row; (*next)++)
+    {
+        uint16_t *sums = row_sums + (size_t)(*next % ring) * n;
+        stream_row(stream, band, start, end, *next, original);
+        for (int c = 0; c < CHANNELS; c++)
+        {
+            int sum = 0;
+            for (int k = -radius; k <= radius; k++)
+            {
+                sum += original[clamp(k, 0, width - 1) * sizeof(rgb) + c];
+            }
+            for (int w = 0; w < width; w++)
+            {
+                sums[w * sizeof(rgb) + c] = sum;
+                sum += original[clamp(w + radius + 1, 0, width - 1) * sizeof(rgb) + c];
+                sum -= original[clamp(w - radius, 0, width - 1) * sizeof(rgb) + c];
+            }
+        }
+    }
+
+    return row_sums + (size_t)(row % ring) * n;
+}
+
+/**
+ * @brief Box blurs a band of rows with running sums across rows and down columns.
+ */
+static void box_band(void *context, int band, int start, int end)
+{
+    band_stream *stream = context;
+    int height = stream->bmp.header.dib.height;
+    int n = stream->bmp.header.dib.width * sizeof(rgb);
+    int radius = stream->radius;
+    int area = (2 * radius + 1) * (2 * radius + 1);
+    unsigned long long reciprocal = ((1ULL << BOX_BITS) + area / 2) / area;
+
+    size_t row_sums_size = sizeof(uint16_t) * (2 * radius + 2) * n;
+    size_t column_sums_size = sizeof(int) * n;
+    unsigned char *original = acquire_buffer(stream->stride);
+    uint16_t *row_sums = acquire_buffer(row_sums_size);
+    int *column_sums = acquire_buffer(column_sums_size);
+    unsigned char *out = acquire_buffer(stream->stride);
+    if (original == NULL || row_sums == NULL || column_sums == NULL || out == NULL)
+    {
+        fprintf(stderr, "Not enough memory to blur rows %i to %i.\n", start, end - 1);
+        release_buffer(original, stream->stride), release_buffer(row_sums, row_sums_size);
+        release_buffer(column_sums, column_sums_size), release_buffer(out, stream->stride);
+        return;
+    }
+    memset(column_sums, 0, column_sums_size);
+    memset(out, 0, stream->stride);
+
+    int next = start - radius < 0 ? 0 : start - radius;
+    for (int h = start; h < end; h++)
+    {
+        if (h == start)
+        {
+            // Sum the whole window of the first row, repeating the top and bottom rows
+            for (int k = -radius; k <= radius; k++)
+            {
+                const uint16_t *sums = box_row(stream, band, start, end, clamp(h + k, 0, height - 1), &next, original, row_sums);
+                for (int i = 0; i < n; i++)
+                {
+                    column_sums[i] += sums[i];
+                }
+            }
+        }
+        else
+        {
+            // Slide the window up a row
+            const uint16_t *entering = box_row(stream, band, start, end, clamp(h + radius, 0, height - 1), &next, original, row_sums);
+            const uint16_t *leaving = box_row(stream, band, start, end, clamp(h - radius - 1, 0, height - 1), &next, original, row_sums);
+            for (int i = 0; i < n; i++)
+            {
+                column_sums[i] += entering[i] - leaving[i];
+            }
+        }
+
+        // Divide by the area and write the row in place
+        for (int i = 0; i < n; i++)
+        {
+            out[i] = (column_sums[i] * reciprocal + (1ULL << (BOX_BITS - 1))) >> BOX_BITS;
+        }
+        write_rows(stream->bmp, h, 1, out);
+    }
+
+    release_buffer(original, stream->stride), release_buffer(row_sums, row_sums_size);
+    release_buffer(column_sums, column_sums_size), release_buffer(out, stream->stride);
+}
+
+/**
+ * @brief Checks the color density and radius of a box blur.
+ * @return Returns 1 when the photo can be blurred, 0 otherwise.
+ */
+static int check_box_blur(bmp_file bmp, int radius)
+{
+    if (!validate_bpp(bmp.header.dib.bpp))
+    {
+        return 0;
+    }
+    if (radius < 1 || radius > MAX_RADIUS)
+    {
+        fprintf(stderr, "Blur radius must be from 1 to %i.\n", MAX_RADIUS);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Box blurs every row of a photo already checked by check_box_blur().
+ * @return Returns 1 when blurred, 0 when the stream cannot be opened.
+ */
+static int run_box_blur(bmp_file bmp, int radius)
+{
+    band_stream stream;
+    if (!open_stream(bmp, radius, NULL, &stream))
+    {
+        return 0;
+    }
+
+    parallel_rows(bmp.header.dib.height, box_band, &stream);
+    release_buffer(stream.halos, stream.halos_size);
+    return 1;
+}
+
+/****************************************/
+/*************** Filters ****************/
+/****************************************/
+void box_blur(bmp_file bmp, int radius)
+{
+    if (!check_box_blur(bmp, radius) || !run_box_blur(bmp, radius))
+    {
+        fprintf(stdout, "Photo was not blurred.\n");
+    }
+}
+
+void blur(bmp_file bmp, int radius)
+{
+    if (!check_box_blur(bmp, radius))
+    {
+        fprintf(stdout, "Photo was not blurred.\n");
+        return;
+    }
+
+    // Each pass blurs the last, stopping once a pass cannot run
+    for (int i = 0; i < 3; i++)
+    {
+        if (!run_box_blur(bmp, radius))
+        {
+            fprintf(stdout, "Photo was not blurred.\n");
+            return;
+        }
+    }
+}
+
+void gaussian_blur(bmp_file bmp, double sigma)
+{
+    if (!validate_bpp(bmp.header.dib.bpp))
+    {
+        fprintf(stdout, "Photo was not blurred.\n");
+        return;
+    }
+    if (sigma <= 0)
+    {
+        fprintf(stderr, "Blur sigma must be positive.\n");
+        fprintf(stdout, "Photo was not blurred.\n");
+        return;
+    }
+
+    separable_filter filter = {1, clamp((int)ceil(3 * sigma), 1, MAX_RADIUS)};
+    gaussian_kernel(sigma, filter.radius, filter.horizontal[0]);
+    memcpy(filter.vertical[0], filter.horizontal[0], sizeof(filter.vertical[0]));
+    filter.combine = blur_combine;
+
+    run_filter(bmp, &filter);
+}
+
+void sharpen(bmp_file bmp, double amount)
+{
+    if (!validate_bpp(bmp.header.dib.bpp))
+    {
+        fprintf(stdout, "Photo was not sharpened.\n");
+        return;
+    }
+
+    // unsharp mask against a [1 2 1] blur
+    int fixed_amount = (int)lround(amount * (1 << AMOUNT_BITS));
+    separable_filter filter = {1, 1, {{32, 64, 32}}, {{32, 64, 32}}, sharpen_combine, &fixed_amount};
+
+    run_filter(bmp, &filter);
+}
+
+void edge_detect(bmp_file bmp)
+{
+    if (!validate_bpp(bmp.header.dib.bpp))
+    {
+        fprintf(stdout, "Photo edges were not detected.\n");
+        return;
+    }
+
+    // horizontal then vertical Sobel gradients
+    separable_filter filter = {2, 1, {{-1, 0, 1}, {1, 2, 1}}, {{1, 2, 1}, {-1, 0, 1}}, edge_combine, NULL};
+
+    run_filter(bmp, &filter);
+}
@@ -0,0 +1,50 @@
+/**
+ * @file filter.h
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Convolution filters for blurring, sharpening, and detecting edges in a bmp photo.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include "stenography.h"
+
+#define MAX_RADIUS 32
+
+/**
+ * @brief Blurs a photo with the average of a square around each pixel.
+ * @details Keeps running sums, so the cost per pixel does not grow with the radius.
+ * @param bmp A bmp photo to blur.
+ * @param radius Half the width of the square, from 1 to MAX_RADIUS.
+ */
+void box_blur(bmp_file bmp, int radius);
+/**
+ * @brief Blurs a photo, approximating a gaussian blur with three box blurs.
+ * @param bmp A bmp photo to blur.
+ * @param radius Radius of each box blur, from 1 to MAX_RADIUS.
+ */
+void blur(bmp_file bmp, int radius);
+/**
+ * @brief Blurs a photo with a gaussian kernel.
+ * @details Applies the kernel across rows then down columns with fixed-point weights.
+ * @param bmp A bmp photo to blur.
+ * @param sigma Standard deviation of the gaussian in pixels, the kernel reaches 3 sigma up to MAX_RADIUS.
+ */
+void gaussian_blur(bmp_file bmp, double sigma);
+/**
+ * @brief Sharpens a photo with an unsharp mask.
+ * @details Adds to each color its difference from a slightly blurred copy of the photo.
+ * @param bmp A bmp photo to sharpen.
+ * @param amount Strength of the sharpening, 1.0 doubles the difference from the blurred photo.
+ */
+void sharpen(bmp_file bmp, double amount);
+/**
+ * @brief Replaces each color with the strength of the edge through it.
+ * @details Sums the magnitudes of the horizontal and vertical Sobel gradients of each channel.
+ * @param bmp A bmp photo.
+ */
+void edge_detect(bmp_file bmp);
+
+#endif
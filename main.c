@@ -7,15 +7,71 @@
 #include <stdio.h>
 #include <string.h>
 #include "stenography.h"
+#include "statistics.h"
+#include "filter.h"
+#include "composite.h"
+#include "pipeline.h"
+#include "daemon.h"
+#include "buffer_pool.h"
+#include "scan.h"
+#include "pyramid.h"
+#include "color.h"
 
 bmp_file prompt_photo(char *prompt);
+void report_lsb_hints(bmp_file bmp);
 
 int main(int argc, char **argv)
 {
+    // run as a service instead of prompting
+    if (argc == 3 && strcmp(argv[1], "--daemon") == 0)
+    {
+        return run_daemon(argv[2]);
+    }
+
+    // inventory the headers of a collection, failing when any photo has a problem
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--scan") == 0)
+    {
+        enum scan_format format = SCAN_CSV;
+        scan_summary summary;
+        if (argc == 4 && !find_scan_format(argv[3], &format))
+        {
+            fprintf(stderr, "%s is not a scan format. Formats are csv and json.\n", argv[3]);
+            return 1;
+        }
+        if (!scan_headers(argv[2], format, stdout, &summary))
+        {
+            return 1;
+        }
+        fprintf(stderr, "Scanned %lu photos, %lu with problems.\n", summary.photos, summary.problems);
+        return summary.problems != 0;
+    }
+
+    // compare two photos, failing when they differ, to check the output of one operation against another
+    if (argc == 4 && strcmp(argv[1], "--compare") == 0)
+    {
+        bmp_file first = open_bmp(argv[2]), second = open_bmp(argv[3]);
+        bmp_comparison comparison;
+        int compared = first.photo != NULL && second.photo != NULL && compare_photos(first, second, &comparison);
+        if (compared)
+        {
+            display_comparison(&comparison);
+        }
+        if (first.photo != NULL)
+        {
+            close_bmp(first);
+        }
+        if (second.photo != NULL)
+        {
+            close_bmp(second);
+        }
+        return !compared || comparison.different != 0;
+    }
+
     printf("\n\nWelcome to image stenography.\n");
     printf("Please select from the options below by typing the number of the operation you wish to perform:\n");
 
     bmp_file bmp, host, hidden;
+    double opacity; // read by both blending and watermarking
     int choice;
     int flag = 1;
     while (flag)
@@ -28,9 +84,22 @@ int main(int argc, char **argv)
         printf("6. Grayscale Photo\n");
         printf("7. Flip Photo\n");
         printf("8. Mirror Photo\n");
+        printf("9. Photo Statistics\n");
+        printf("10. Auto Contrast Photo\n");
+        printf("11. Equalize Photo\n");
+        printf("12. Blur Photo\n");
+        printf("13. Sharpen Photo\n");
+        printf("14. Detect Photo Edges\n");
+        printf("15. Blend Photos\n");
+        printf("16. Watermark Photo\n");
+        printf("17. Run Operations on Photo\n");
+        printf("18. Scan Photo Headers\n");
+        printf("19. Build Photo Pyramid\n");
+        printf("20. Adjust Photo Colors\n");
+        printf("21. Compare Photos\n");
         printf("Your Response:\t");
 
-        scanf("%1d", &choice);
+        scanf("%d", &choice);
         printf("\n");
 
         switch (choice)
@@ -51,7 +120,10 @@ int main(int argc, char **argv)
             bmp = prompt_photo("Enter the filepath of the bmp file.\n");
 
             // reveal the hidden photo
-            reveal(bmp);
+            if (reveal(bmp))
+            {
+                report_lsb_hints(bmp);
+            }
 
             // close file
             close_bmp(bmp);
@@ -62,7 +134,10 @@ int main(int argc, char **argv)
             bmp = prompt_photo("Enter the filepath of the bmp file.\n");
 
             // show both the hidden and original photo
-            peek(bmp);
+            if (peek(bmp))
+            {
+                report_lsb_hints(bmp);
+            }
 
             // close file
             close_bmp(bmp);
@@ -74,7 +149,10 @@ int main(int argc, char **argv)
             hidden = prompt_photo("Enter the filepath of the bmp file that will be hidden.\n");
 
             // hide the photo
-            hide(host, hidden);
+            if (hide(host, hidden))
+            {
+                report_lsb_hints(host);
+            }
 
             // close files
             close_bmp(host);
@@ -122,6 +200,239 @@ int main(int argc, char **argv)
             close_bmp(bmp);
             break;
 
+        case 9:
+            // prompt for bmp file
+            bmp = prompt_photo("Enter the filepath of the bmp file.\n");
+
+            // display the color statistics, hidden photo hints, and memory held for photos
+            bmp_stats stats;
+            if (compute_stats(bmp, &stats))
+            {
+                display_stats(&stats);
+                display_lsb_hints(&stats);
+            }
+            display_buffer_pool_stats();
+
+            close_bmp(bmp);
+            break;
+
+        case 10:
+            // prompt for bmp file
+            bmp = prompt_photo("Enter the filepath of the bmp file.\n");
+
+            // stretch each channel to the full range
+            auto_contrast(bmp);
+
+            close_bmp(bmp);
+            break;
+
+        case 11:
+            // prompt for bmp file
+            bmp = prompt_photo("Enter the filepath of the bmp file.\n");
+
+            // equalize each channel's histogram
+            equalize(bmp);
+
+            close_bmp(bmp);
+            break;
+
+        case 12:
+            // prompt for bmp file and blur radius
+            bmp = prompt_photo("Enter the filepath of the bmp file.\n");
+            int radius = 0;
+            printf("Enter the blur radius in pixels, from 1 to %i.\n", MAX_RADIUS);
+            scanf("%d", &radius);
+
+            // blur the photo
+            blur(bmp, radius);
+
+            close_bmp(bmp);
+            break;
+
+        case 13:
+            // prompt for bmp file and sharpening amount
+            bmp = prompt_photo("Enter the filepath of the bmp file.\n");
+            double amount = 0;
+            printf("Enter the sharpening amount, such as 1.0.\n");
+            scanf("%lf", &amount);
+
+            // sharpen the photo
+            sharpen(bmp, amount);
+
+            close_bmp(bmp);
+            break;
+
+        case 14:
+            // prompt for bmp file
+            bmp = prompt_photo("Enter the filepath of the bmp file.\n");
+
+            // replace the photo with its edges
+            edge_detect(bmp);
+
+            close_bmp(bmp);
+            break;
+
+        case 15:
+            // open target and source photos
+            host = prompt_photo("Enter the filepath of the bmp file which will be blended into.\n");
+            hidden = prompt_photo("Enter the filepath of the bmp file to blend into the first.\n");
+
+            // prompt for blend mode and opacity
+            int mode = 0;
+            printf("Enter the blend mode: 0 for alpha, 1 for add, 2 for multiply, or 3 for difference.\n");
+            int read_mode = scanf("%d", &mode);
+            printf("Enter the opacity, from 0.0 to 1.0.\n");
+
+            // blend the photos
+            if (read_mode != 1 || scanf("%lf", &opacity) != 1)
+            {
+                printf("This is an invalid blend mode or opacity.\n");
+                scanf("%*[^\n]");
+            }
+            else if (mode < 0 || mode >= BLEND_MODES)
+            {
+                printf("This is an invalid blend mode.\n");
+            }
+            else
+            {
+                composite(host, hidden, mode, opacity);
+            }
+
+            // close files
+            close_bmp(host);
+            close_bmp(hidden);
+            break;
+
+        case 16:
+            // open target and watermark photos
+            host = prompt_photo("Enter the filepath of the bmp file to watermark.\n");
+            hidden = prompt_photo("Enter the filepath of the watermark bmp file.\n");
+
+            // prompt for position and opacity
+            int x = 0, y = 0;
+            printf("Enter the pixels from the left and top edges to place the watermark.\n");
+            int read_position = scanf("%d %d", &x, &y);
+            printf("Enter the opacity, from 0.0 to 1.0.\n");
+
+            // overlay the watermark
+            if (read_position != 2 || scanf("%lf", &opacity) != 1)
+            {
+                printf("This is an invalid position or opacity.\n");
+                scanf("%*[^\n]");
+            }
+            else
+            {
+                watermark(host, hidden, x, y, opacity);
+            }
+
+            // close files
+            close_bmp(host);
+            close_bmp(hidden);
+            break;
+
+        case 17:
+            // prompt for bmp file and operations
+            bmp = prompt_photo("Enter the filepath of the bmp file.\n");
+            char chain[256] = "";
+            pipeline_stage stages[MAX_STAGES];
+            printf("Enter the operations to run in order, such as grayscale,invert or hue:90,saturation:1.5.\n");
+            printf("Operations are invert, reveal, grayscale, hue:<degrees>, saturation:<factor>, brightness:<factor>, ycbcr, and rgb.\n");
+            scanf(" %255[^\n]", chain);
+
+            // run every operation in a single pass
+            int count = parse_pipeline(chain, stages);
+            if (count >= 0)
+            {
+                run_pipeline(bmp, stages, count);
+            }
+
+            close_bmp(bmp);
+            break;
+
+        case 18:
+        {
+            // prompt for directory and format
+            char root[256] = "", format_name[16] = "";
+            enum scan_format format;
+            scan_summary summary;
+            printf("Enter the directory to scan.\n");
+            scanf(" %255[^\n]", root);
+            printf("Enter the format of the results, csv or json.\n");
+            scanf("%15s", format_name);
+
+            // list every header below the directory
+            if (!find_scan_format(format_name, &format))
+            {
+                fprintf(stderr, "%s is not a scan format. Formats are csv and json.\n", format_name);
+                printf("Photos were not scanned.\n");
+            }
+            else if (scan_headers(root, format, stdout, &summary))
+            {
+                printf("Scanned %lu photos, %lu with problems.\n", summary.photos, summary.problems);
+            }
+            else
+            {
+                printf("Photos were not scanned.\n");
+            }
+            break;
+        }
+
+        case 19:
+            // prompt for bmp file, levels, and where to write them
+            bmp = prompt_photo("Enter the filepath of the bmp file.\n");
+            char prefix[256] = "";
+            int levels = 0;
+            printf("Enter the number of levels, each half the size of the last, from 1 to %i.\n", MAX_LEVELS);
+            scanf("%d", &levels);
+            printf("Enter the start of the level filepaths, level n is written to <start>_<2^n>.bmp.\n");
+            scanf(" %255[^\n]", prefix);
+
+            // write every level in one pass over the photo
+            int built = build_pyramid(bmp, prefix, levels);
+            if (built)
+            {
+                printf("Wrote %i levels.\n", built);
+            }
+
+            close_bmp(bmp);
+            break;
+
+        case 20:
+            // prompt for bmp file and adjustments
+            bmp = prompt_photo("Enter the filepath of the bmp file.\n");
+            double degrees = 0, saturation = 1, brightness = 1;
+            printf("Enter the degrees to rotate the hue.\n");
+            scanf("%lf", &degrees);
+            printf("Enter the saturation and brightness factors, 1.0 for no change, up to %.1f.\n", MAX_COLOR_FACTOR);
+            scanf("%lf %lf", &saturation, &brightness);
+
+            // adjust every pixel in one pass
+            adjust_colors(bmp, degrees, saturation, brightness);
+
+            close_bmp(bmp);
+            break;
+
+        case 21:
+            // open both photos
+            host = prompt_photo("Enter the filepath of the first bmp file.\n");
+            hidden = prompt_photo("Enter the filepath of the bmp file to compare with the first.\n");
+
+            // display how the photos differ
+            bmp_comparison comparison;
+            if (compare_photos(host, hidden, &comparison))
+            {
+                display_comparison(&comparison);
+            }
+            else
+            {
+                printf("Photos were not compared.\n");
+            }
+
+            // close files
+            close_bmp(host);
+            close_bmp(hidden);
+            break;
+
         default:
             printf("This is an invalid option.\n");
             break;
@@ -181,4 +492,13 @@ bmp_file prompt_photo(char *prompt)
     }
 
     return bmp;
-}
\ No newline at end of file
+}
+
+void report_lsb_hints(bmp_file bmp)
+{
+    bmp_stats stats;
+    if (compute_stats(bmp, &stats))
+    {
+        display_lsb_hints(&stats);
+    }
+}
@@ -0,0 +1,175 @@
+/**
+ * @file parallel.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Splits the rows of a photo into bands processed by separate threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "parallel.h"
+
+#define MAX_BANDS 64
+#define MIN_BAND_ROWS 16
+
+/**
+ * A band of rows handed to a thread
+ */
+typedef struct
+{
+    band_work work;
+    void *context;
+    int band, start, end;
+} band_task;
+
+/**
+ * Worker threads kept waiting between calls to parallel_rows
+ */
+static struct
+{
+    pthread_mutex_t lock, submit;
+    pthread_cond_t ready, done;
+    band_task tasks[MAX_BANDS];
+    int bands, next, remaining;
+    int workers;
+} pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+static int processor_count(void)
+{
+    // STENOGRAPHY_THREADS overrides the processors online, so bands can be split on any machine
+    const char *threads = getenv("STENOGRAPHY_THREADS");
+    long processors = threads != NULL && atoi(threads) > 0 ? atoi(threads) : sysconf(_SC_NPROCESSORS_ONLN);
+    return processors > 0 ? (int)processors : 1;
+}
+
+/**
+ * @brief Takes the next band of the current call, if any, and runs it.
+ * @details Called with the pool locked, returns with the pool locked.
+ * @return Returns 1 when a band was run, 0 when none remain.
+ */
+static int run_next_band(void)
+{
+    if (pool.next >= pool.bands)
+    {
+        return 0;
+    }
+
+    band_task task = pool.tasks[pool.next++];
+    pthread_mutex_unlock(&pool.lock);
+    task.work(task.context, task.band, task.start, task.end);
+    pthread_mutex_lock(&pool.lock);
+
+    if (--pool.remaining == 0)
+    {
+        pthread_cond_signal(&pool.done);
+    }
+    return 1;
+}
+
+static void *worker(void *arg)
+{
+    pthread_mutex_lock(&pool.lock);
+    while (1)
+    {
+        if (!run_next_band())
+        {
+            pthread_cond_wait(&pool.ready, &pool.lock);
+        }
+    }
+    return NULL;
+}
+
+static void create_workers(void)
+{
+    // the calling thread runs bands as well
+    int workers = processor_count() - 1;
+    workers = workers > MAX_BANDS - 1 ? MAX_BANDS - 1 : workers;
+
+    for (int w = 0; w < workers; w++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker, NULL) != 0)
+        {
+            fprintf(stderr, "Failed to start a thread, running with %i threads.\n", pool.workers + 1);
+            break;
+        }
+        pthread_detach(thread);
+        pool.workers++;
+    }
+}
+
+void start_workers(void)
+{
+    pthread_once(&pool_once, create_workers);
+}
+
+int band_count(int rows)
+{
+    int bands = processor_count();
+
+    // keep bands large enough to be worth a thread
+    if (bands > rows / MIN_BAND_ROWS)
+    {
+        bands = rows / MIN_BAND_ROWS;
+    }
+    if (bands > MAX_BANDS)
+    {
+        bands = MAX_BANDS;
+    }
+    return bands < 1 ? 1 : bands;
+}
+
+void band_bounds(int rows, int band, int *start, int *end)
+{
+    int bands = band_count(rows);
+    int size = rows / bands, remainder = rows % bands;
+    *start = band * size + (band < remainder ? band : remainder);
+    *end = *start + size + (band < remainder);
+}
+
+int band_rows(int stride)
+{
+    int rows = BAND_BYTES / stride;
+    return rows < 1 ? 1 : rows;
+}
+
+void parallel_rows(int rows, band_work work, void *context)
+{
+    int bands = band_count(rows);
+    if (bands == 1)
+    {
+        work(context, 0, 0, rows);
+        return;
+    }
+
+    start_workers();
+
+    // one call uses the workers at a time
+    pthread_mutex_lock(&pool.submit);
+    pthread_mutex_lock(&pool.lock);
+    for (int b = 0; b < bands; b++)
+    {
+        pool.tasks[b] = (band_task){work, context, b, 0, 0};
+        band_bounds(rows, b, &pool.tasks[b].start, &pool.tasks[b].end);
+    }
+    pool.bands = bands;
+    pool.next = 0;
+    pool.remaining = bands;
+    pthread_cond_broadcast(&pool.ready);
+
+    // run bands alongside the workers, then wait for theirs to finish
+    while (run_next_band())
+    {
+    }
+    while (pool.remaining > 0)
+    {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool.submit);
+}
@@ -0,0 +1,62 @@
+/**
+ * @file parallel.h
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Splits the rows of a photo into bands processed by separate threads.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#define BAND_BYTES (1 << 18) // bytes of rows a band holds in memory at once, sized to stay in cache
+
+/**
+ * Work performed on one band of rows
+ * @param context State shared by every band.
+ * @param band Index of the band, from 0 to one less than the number of bands.
+ * @param start The first row of the band.
+ * @param end One past the last row of the band.
+ */
+typedef void (*band_work)(void *context, int band, int start, int end);
+
+/**
+ * @brief Starts the worker threads ahead of the first call to parallel_rows.
+ * @details Workers start once, one fewer than the number of processors.
+ */
+void start_workers(void);
+/**
+ * @brief Number of bands the rows are split into.
+ * @details One band per processor, or per thread of STENOGRAPHY_THREADS when set, but never
+ *          a band smaller than MIN_BAND_ROWS rows.
+ *          Use to size per-band private state before calling parallel_rows.
+ * @param rows Number of rows to split.
+ * @return Returns the number of bands, at least 1.
+ */
+int band_count(int rows);
+/**
+ * @brief Rows of one band.
+ * @details Rows are split evenly, the first bands take the remainder.
+ * @param rows Number of rows split into band_count(rows) bands.
+ * @param band Index of the band.
+ * @param start Set to the first row of the band.
+ * @param end Set to one past the last row of the band.
+ */
+void band_bounds(int rows, int band, int *start, int *end);
+/**
+ * @brief Rows a band reads or writes at once.
+ * @param stride Bytes of each row, including padding.
+ * @return Returns the rows fitting in BAND_BYTES, at least 1.
+ */
+int band_rows(int stride);
+/**
+ * @brief Runs work over every band of rows and waits for all bands to finish.
+ * @details Bands run on worker threads kept between calls and on the calling thread.
+ *          Calls from several threads take turns; work must not call parallel_rows itself.
+ * @param rows Number of rows to split into band_count(rows) bands.
+ * @param work Work performed on each band.
+ * @param context State passed to every call of work.
+ */
+void parallel_rows(int rows, band_work work, void *context);
+
+#endif
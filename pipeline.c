@@ -0,0 +1,321 @@
+/**
+ * @file pipeline.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Chains of per pixel kernels run over a bmp photo in a single pass.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pipeline.h"
+#include "parallel.h"
+#include "buffer_pool.h"
+#include "color.h"
+
+/**
+ * A pipeline run over a bmp photo
+ */
+typedef struct
+{
+    bmp_file source, destination;
+    const pipeline_stage *stages;
+    int count;
+} pipeline_job;
+
+/****************************************/
+/*************** Kernels ****************/
+/****************************************/
+static void invert_kernel(pixel_band *band, double amount)
+{
+    for (int r = 0; r < band->rows; r++)
+    {
+        unsigned char *colors = band->colors + (size_t)r * band->stride;
+        for (int i = 0; i < band->width * CHANNELS; i++)
+        {
+            colors[i] = ~colors[i];
+        }
+    }
+}
+
+static void reveal_kernel(pixel_band *band, double amount)
+{
+    for (int r = 0; r < band->rows; r++)
+    {
+        unsigned char *colors = band->colors + (size_t)r * band->stride;
+        for (int i = 0; i < band->width * CHANNELS; i++)
+        {
+            colors[i] = colors[i] << 4 | colors[i] >> 4;
+        }
+    }
+}
+
+static void grayscale_kernel(pixel_band *band, double amount)
+{
+    const double *linear = linear_colors();
+
+    for (int r = 0; r < band->rows; r++)
+    {
+        unsigned char *blue = band->planes[CHANNEL_BLUE] + (size_t)r * band->plane_stride;
+        unsigned char *green = band->planes[CHANNEL_GREEN] + (size_t)r * band->plane_stride;
+        unsigned char *red = band->planes[CHANNEL_RED] + (size_t)r * band->plane_stride;
+        for (int w = 0; w < band->width; w++)
+        {
+            double luminance = 0.2126 * linear[red[w]] + 0.7152 * linear[green[w]] + 0.0722 * linear[blue[w]];
+            blue[w] = green[w] = red[w] = table_delinearize(luminance);
+        }
+    }
+}
+
+/**
+ * @brief Transforms every row of a planar band.
+ */
+static void transform_band(pixel_band *band, const color_matrix *matrix)
+{
+    for (int r = 0; r < band->rows; r++)
+    {
+        unsigned char *planes[CHANNELS];
+        for (int p = 0; p < CHANNELS; p++)
+        {
+            planes[p] = band->planes[p] + (size_t)r * band->plane_stride;
+        }
+        transform_row(matrix, planes, band->width);
+    }
+}
+
+static void hue_kernel(pixel_band *band, double amount)
+{
+    color_matrix matrix = hue_matrix(amount);
+    transform_band(band, &matrix);
+}
+
+static void saturation_kernel(pixel_band *band, double amount)
+{
+    color_matrix matrix = saturation_matrix(amount);
+    transform_band(band, &matrix);
+}
+
+static void brightness_kernel(pixel_band *band, double amount)
+{
+    color_matrix matrix = brightness_matrix(amount);
+    transform_band(band, &matrix);
+}
+
+static void ycbcr_kernel(pixel_band *band, double amount)
+{
+    color_matrix matrix = ycbcr_matrix();
+    transform_band(band, &matrix);
+}
+
+static void rgb_kernel(pixel_band *band, double amount)
+{
+    color_matrix matrix = rgb_matrix();
+    transform_band(band, &matrix);
+}
+
+static const pixel_kernel kernels[] = {
+    {"invert", LAYOUT_INTERLEAVED, invert_kernel, 0},
+    {"reveal", LAYOUT_INTERLEAVED, reveal_kernel, 0},
+    {"grayscale", LAYOUT_PLANAR, grayscale_kernel, 0},
+    {"hue", LAYOUT_PLANAR, hue_kernel, 1},
+    {"saturation", LAYOUT_PLANAR, saturation_kernel, 1},
+    {"brightness", LAYOUT_PLANAR, brightness_kernel, 1},
+    {"ycbcr", LAYOUT_PLANAR, ycbcr_kernel, 0},
+    {"rgb", LAYOUT_PLANAR, rgb_kernel, 0},
+};
+
+/****************************************/
+/*************** Pipeline ***************/
+/****************************************/
+const pixel_kernel *find_kernel(const char *name)
+{
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+    {
+        if (strcmp(kernels[k].name, name) == 0)
+        {
+            return &kernels[k];
+        }
+    }
+    return NULL;
+}
+
+int parse_pipeline(const char *chain, pipeline_stage stages[MAX_STAGES])
+{
+    int count = 0;
+    char name[32];
+    while (*chain)
+    {
+        // skip separators, then copy the next name
+        size_t skip = strspn(chain, " ,\t\n");
+        size_t length = strcspn(chain + skip, " ,\t\n");
+        chain += skip;
+        if (length == 0)
+        {
+            break;
+        }
+        if (length >= sizeof(name) || count == MAX_STAGES)
+        {
+            fprintf(stderr, "Pipeline has an invalid operation or too many operations.\n");
+            return -1;
+        }
+        memcpy(name, chain, length);
+        name[length] = '\0';
+        chain += length;
+
+        // split off the amount
+        char *amount = strchr(name, ':');
+        if (amount != NULL)
+        {
+            *amount++ = '\0';
+        }
+
+        stages[count].kernel = find_kernel(name);
+        stages[count].amount = 0;
+        if (stages[count].kernel == NULL)
+        {
+            fprintf(stderr, "%s is not a known operation.\n", name);
+            return -1;
+        }
+        if (stages[count].kernel->takes_amount != (amount != NULL))
+        {
+            fprintf(stderr, amount ? "%s does not take an amount.\n" : "%s needs an amount after a colon.\n", name);
+            return -1;
+        }
+        if (amount != NULL)
+        {
+            char *end;
+            stages[count].amount = strtod(amount, &end);
+            if (end == amount || *end != '\0')
+            {
+                fprintf(stderr, "%s is not a valid amount for %s.\n", amount, name);
+                return -1;
+            }
+        }
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Converts a band between layouts.
+ */
+static void convert_band(pixel_band *band, enum pixel_layout layout)
+{
+    for (int r = 0; r < band->rows; r++)
+    {
+        unsigned char *colors = band->colors + (size_t)r * band->stride;
+        unsigned char *planes[CHANNELS];
+        for (int p = 0; p < CHANNELS; p++)
+        {
+            planes[p] = band->planes[p] + (size_t)r * band->plane_stride;
+        }
+
+        if (layout == LAYOUT_PLANAR)
+        {
+            deinterleave_row(colors, planes, band->width);
+        }
+        else
+        {
+            interleave_row(planes, colors, band->width);
+        }
+    }
+}
+
+/**
+ * @brief Returns the rows of a band to the buffer pool.
+ */
+static void release_band(pixel_band *band, size_t colors_size, size_t plane_size)
+{
+    release_buffer(band->colors, colors_size);
+    for (int p = 0; p < CHANNELS; p++)
+    {
+        release_buffer(band->planes[p], plane_size);
+    }
+}
+
+static void pipeline_band(void *context, int index, int start, int end)
+{
+    pipeline_job *job = context;
+    int width = job->source.header.dib.width;
+    int stride = row_stride(job->source.header);
+    int rows = band_rows(stride);
+    pixel_band band = {width, 0, NULL, stride, {NULL}, plane_stride(width)};
+
+    // Planes are only needed when a kernel prefers them
+    int planar = 0;
+    for (int s = 0; s < job->count; s++)
+    {
+        planar |= job->stages[s].kernel->layout == LAYOUT_PLANAR;
+    }
+
+    // Band rows come from the buffer pool, so repeated jobs reuse them
+    size_t colors_size = (size_t)rows * stride;
+    size_t plane_size = planar ? (size_t)rows * band.plane_stride : 0;
+    int reserved = (band.colors = acquire_buffer(colors_size)) != NULL;
+    for (int p = 0; p < CHANNELS && planar; p++)
+    {
+        reserved &= (band.planes[p] = acquire_buffer(plane_size)) != NULL;
+    }
+    if (!reserved)
+    {
+        fprintf(stderr, "Not enough memory to process rows %i to %i.\n", start, end - 1);
+        release_band(&band, colors_size, plane_size);
+        return;
+    }
+
+    for (int h = start; h < end; h += rows)
+    {
+        band.rows = end - h < rows ? end - h : rows;
+        read_rows(job->source, h, band.rows, band.colors);
+
+        // Run each stage, converting only when the layout changes
+        enum pixel_layout layout = LAYOUT_INTERLEAVED;
+        for (int s = 0; s < job->count; s++)
+        {
+            const pixel_kernel *kernel = job->stages[s].kernel;
+            if (kernel->layout != layout)
+            {
+                layout = kernel->layout;
+                convert_band(&band, layout);
+            }
+            kernel->apply(&band, job->stages[s].amount);
+        }
+        if (layout != LAYOUT_INTERLEAVED)
+        {
+            convert_band(&band, LAYOUT_INTERLEAVED);
+        }
+
+        write_rows(job->destination, h, band.rows, band.colors);
+    }
+    release_band(&band, colors_size, plane_size);
+}
+
+void run_pipeline(bmp_file bmp, const pipeline_stage *stages, int count)
+{
+    run_pipeline_into(bmp, bmp, stages, count);
+}
+
+void run_pipeline_into(bmp_file source, bmp_file destination, const pipeline_stage *stages, int count)
+{
+    if (!validate_bpp(source.header.dib.bpp))
+    {
+        fprintf(stdout, "Photo was not processed.\n");
+        return;
+    }
+    if (source.header.dib.width != destination.header.dib.width ||
+        source.header.dib.height != destination.header.dib.height)
+    {
+        fprintf(stderr, "The two photos are not the same size. Images must be the same height and width.\n");
+        fprintf(stdout, "Photo was not processed.\n");
+        return;
+    }
+
+    pipeline_job job = {source, destination, stages, count};
+    parallel_rows(source.header.dib.height, pipeline_band, &job);
+}
+
+void prepare_kernels(void)
+{
+    prepare_color_tables();
+}
@@ -0,0 +1,88 @@
+/**
+ * @file pipeline.h
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Chains of per pixel kernels run over a bmp photo in a single pass.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "stenography.h"
+#include "planar.h"
+
+#define MAX_STAGES 16
+
+/**
+ * Rows of pixels handed to a kernel, in the layout the kernel prefers
+ */
+typedef struct
+{
+    int width, rows;
+    unsigned char *colors;           // interleaved rows
+    int stride;                      // bytes per interleaved row
+    unsigned char *planes[CHANNELS]; // planar rows, indexed by channel
+    int plane_stride;                // bytes per planar row
+} pixel_band;
+/**
+ * Alters each pixel of a band of rows
+ * @param band Rows to alter, in the layout of the kernel.
+ * @param amount Amount of the stage, such as the degrees of a hue rotation.
+ */
+typedef void (*kernel_function)(pixel_band *band, double amount);
+/**
+ * A per pixel operation and the layout it prefers
+ */
+typedef struct
+{
+    const char *name;
+    enum pixel_layout layout;
+    kernel_function apply;
+    int takes_amount; // 1 when the name is followed by :<amount>, such as hue:90
+} pixel_kernel;
+/**
+ * A kernel and its settings within a pipeline
+ */
+typedef struct
+{
+    const pixel_kernel *kernel;
+    double amount;
+} pipeline_stage;
+
+/**
+ * @brief Finds a built in kernel by name: invert, reveal, grayscale, hue, saturation, brightness, ycbcr, or rgb.
+ * @param name Name of the kernel.
+ * @return Returns the kernel, or NULL when there is no kernel with the name.
+ */
+const pixel_kernel *find_kernel(const char *name);
+/**
+ * @brief Parses a chain of kernel names separated by spaces or commas.
+ * @details Kernels taking an amount are followed by a colon and the amount.
+ * @param chain Names of the kernels in the order they run, such as "grayscale,invert" or "hue:90,saturation:1.5".
+ * @param stages Filled with a stage for each kernel.
+ * @return Returns the number of stages, or -1 when a name or amount is invalid or there are over MAX_STAGES.
+ */
+int parse_pipeline(const char *chain, pipeline_stage stages[MAX_STAGES]);
+/**
+ * @brief Runs every stage over each band of rows before writing it back.
+ * @details Rows are converted between layouts only when the next kernel prefers the other layout.
+ * @param bmp A bmp photo to alter.
+ * @param stages Stages in the order they run.
+ * @param count Number of stages.
+ */
+void run_pipeline(bmp_file bmp, const pipeline_stage *stages, int count);
+/**
+ * @brief Runs every stage over each band of rows of a photo, writing the result to another photo.
+ * @param source A bmp photo to read.
+ * @param destination A bmp photo of the same size to write.
+ * @param stages Stages in the order they run.
+ * @param count Number of stages.
+ */
+void run_pipeline_into(bmp_file source, bmp_file destination, const pipeline_stage *stages, int count);
+/**
+ * @brief Builds the tables used by the kernels ahead of their first use.
+ */
+void prepare_kernels(void);
+
+#endif
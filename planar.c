@@ -0,0 +1,309 @@
+/**
+ * @file planar.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Planar layout of pixels, storing each color channel in its own plane.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <tmmintrin.h>
+#define SSSE3_SHUFFLES // rows are shuffled with SSSE3 when the processor has it, checked at run time
+#endif
+#include "planar.h"
+#include "parallel.h"
+#include "buffer_pool.h"
+
+/**
+ * A planar image converted to or from a bmp photo in bands
+ */
+typedef struct
+{
+    bmp_file bmp;
+    planar_image *image;
+    int failed; // set by a band that could not convert its rows
+} planar_job;
+
+/****************************************/
+/************** Conversion **************/
+/****************************************/
+#ifdef SSSE3_SHUFFLES
+/**
+ * Shuffle masks moving 16 pixels of interleaved colors to or from 16 bytes of each plane
+ */
+static struct
+{
+    char gather[CHANNELS][3][16];  // gathers plane p from the 16 byte chunk k of colors, at [p][k]
+    char scatter[3][CHANNELS][16]; // scatters plane p into the 16 byte chunk k of colors, at [k][p]
+    int ssse3;                     // whether the processor has SSSE3
+} shuffles;
+static pthread_once_t shuffles_once = PTHREAD_ONCE_INIT;
+
+static void build_shuffles(void)
+{
+    memset(shuffles.gather, 0x80, sizeof(shuffles.gather));
+    memset(shuffles.scatter, 0x80, sizeof(shuffles.scatter));
+    for (int i = 0; i < 16 * CHANNELS; i++)
+    {
+        int pixel = i / CHANNELS, channel = i % CHANNELS;
+        shuffles.gather[channel][i / 16][pixel] = i % 16;
+        shuffles.scatter[i / 16][channel][i % 16] = pixel;
+    }
+    shuffles.ssse3 = __builtin_cpu_supports("ssse3");
+}
+
+/**
+ * @brief Deinterleaves 16 pixels at a time.
+ * @return Returns the number of pixels deinterleaved.
+ */
+__attribute__((target("ssse3"))) static int deinterleave_ssse3(const unsigned char *restrict colors, unsigned char *restrict planes[CHANNELS], int width)
+{
+    __m128i split[CHANNELS][3];
+    for (int p = 0; p < CHANNELS; p++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            split[p][k] = _mm_loadu_si128((const __m128i *)shuffles.gather[p][k]);
+        }
+    }
+
+    int w = 0;
+    for (; w + 16 <= width; w += 16)
+    {
+        __m128i chunks[3];
+        for (int k = 0; k < 3; k++)
+        {
+            chunks[k] = _mm_loadu_si128((const __m128i *)(colors + w * CHANNELS + 16 * k));
+        }
+        for (int p = 0; p < CHANNELS; p++)
+        {
+            __m128i plane = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(chunks[0], split[p][0]),
+                                                      _mm_shuffle_epi8(chunks[1], split[p][1])),
+                                         _mm_shuffle_epi8(chunks[2], split[p][2]));
+            _mm_storeu_si128((__m128i *)(planes[p] + w), plane);
+        }
+    }
+    return w;
+}
+
+/**
+ * @brief Interleaves 16 pixels at a time.
+ * @return Returns the number of pixels interleaved.
+ */
+__attribute__((target("ssse3"))) static int interleave_ssse3(unsigned char *const restrict planes[CHANNELS], unsigned char *restrict colors, int width)
+{
+    __m128i join[3][CHANNELS];
+    for (int k = 0; k < 3; k++)
+    {
+        for (int p = 0; p < CHANNELS; p++)
+        {
+            join[k][p] = _mm_loadu_si128((const __m128i *)shuffles.scatter[k][p]);
+        }
+    }
+
+    int w = 0;
+    for (; w + 16 <= width; w += 16)
+    {
+        __m128i plane[CHANNELS];
+        for (int p = 0; p < CHANNELS; p++)
+        {
+            plane[p] = _mm_loadu_si128((const __m128i *)(planes[p] + w));
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            __m128i chunk = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(plane[0], join[k][0]),
+                                                      _mm_shuffle_epi8(plane[1], join[k][1])),
+                                         _mm_shuffle_epi8(plane[2], join[k][2]));
+            _mm_storeu_si128((__m128i *)(colors + w * CHANNELS + 16 * k), chunk);
+        }
+    }
+    return w;
+}
+#endif
+
+void deinterleave_row(const unsigned char *restrict colors, unsigned char *restrict planes[CHANNELS], int width)
+{
+    int w = 0;
+#ifdef SSSE3_SHUFFLES
+    pthread_once(&shuffles_once, build_shuffles);
+    if (shuffles.ssse3)
+    {
+        w = deinterleave_ssse3(colors, planes, width);
+    }
+#endif
+    for (; w < width; w++)
+    {
+        planes[CHANNEL_BLUE][w] = colors[w * CHANNELS + CHANNEL_BLUE];
+        planes[CHANNEL_GREEN][w] = colors[w * CHANNELS + CHANNEL_GREEN];
+        planes[CHANNEL_RED][w] = colors[w * CHANNELS + CHANNEL_RED];
+    }
+}
+
+void interleave_row(unsigned char *const restrict planes[CHANNELS], unsigned char *restrict colors, int width)
+{
+    int w = 0;
+#ifdef SSSE3_SHUFFLES
+    pthread_once(&shuffles_once, build_shuffles);
+    if (shuffles.ssse3)
+    {
+        w = interleave_ssse3(planes, colors, width);
+    }
+#endif
+    for (; w < width; w++)
+    {
+        colors[w * CHANNELS + CHANNEL_BLUE] = planes[CHANNEL_BLUE][w];
+        colors[w * CHANNELS + CHANNEL_GREEN] = planes[CHANNEL_GREEN][w];
+        colors[w * CHANNELS + CHANNEL_RED] = planes[CHANNEL_RED][w];
+    }
+}
+
+int plane_stride(int width)
+{
+    return (width + PLANE_ALIGNMENT - 1) / PLANE_ALIGNMENT * PLANE_ALIGNMENT;
+}
+
+/****************************************/
+/************* Planar Image *************/
+/****************************************/
+int create_planar(planar_image *image, int width, int height)
+{
+    image->width = width;
+    image->height = height;
+    image->stride = plane_stride(width);
+
+    // Whole planes bypass the buffer pool, so their memory returns to the system when freed
+    size_t size = (size_t)image->stride * (height > 0 ? height : 1);
+    for (int p = 0; p < CHANNELS; p++)
+    {
+        image->planes[p] = aligned_alloc(PLANE_ALIGNMENT, size);
+    }
+
+    if (image->planes[CHANNEL_BLUE] == NULL || image->planes[CHANNEL_GREEN] == NULL || image->planes[CHANNEL_RED] == NULL)
+    {
+        fprintf(stderr, "Not enough memory for the planes of the photo.\n");
+        free_planar(image);
+        return 0;
+    }
+    return 1;
+}
+
+void free_planar(planar_image *image)
+{
+    for (int p = 0; p < CHANNELS; p++)
+    {
+        free(image->planes[p]);
+        image->planes[p] = NULL;
+    }
+}
+
+/**
+ * @brief Points at a row of each plane.
+ */
+static void plane_rows(const planar_image *image, int row, unsigned char *rows[CHANNELS])
+{
+    for (int p = 0; p < CHANNELS; p++)
+    {
+        rows[p] = image->planes[p] + (size_t)row * image->stride;
+    }
+}
+
+static void load_band(void *context, int band, int start, int end)
+{
+    planar_job *job = context;
+    int stride = row_stride(job->bmp.header);
+    int rows = band_rows(stride);
+    size_t size = (size_t)rows * stride;
+    unsigned char *colors = acquire_buffer(size);
+    if (colors == NULL)
+    {
+        fprintf(stderr, "Not enough memory to load rows %i to %i.\n", start, end - 1);
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    for (int h = start; h < end; h += rows)
+    {
+        int count = end - h < rows ? end - h : rows;
+        read_rows(job->bmp, h, count, colors);
+        for (int r = 0; r < count; r++)
+        {
+            unsigned char *planes[CHANNELS];
+            plane_rows(job->image, h + r, planes);
+            deinterleave_row(colors + (size_t)r * stride, planes, job->image->width);
+        }
+    }
+
+    release_buffer(colors, size);
+}
+
+static void save_band(void *context, int band, int start, int end)
+{
+    planar_job *job = context;
+    int stride = row_stride(job->bmp.header);
+    int rows = band_rows(stride);
+    size_t size = (size_t)rows * stride;
+    unsigned char *colors = acquire_buffer(size);
+    if (colors == NULL)
+    {
+        fprintf(stderr, "Not enough memory to save rows %i to %i.\n", start, end - 1);
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    memset(colors, 0, size);
+
+    for (int h = start; h < end; h += rows)
+    {
+        int count = end - h < rows ? end - h : rows;
+        for (int r = 0; r < count; r++)
+        {
+            unsigned char *planes[CHANNELS];
+            plane_rows(job->image, h + r, planes);
+            interleave_row(planes, colors + (size_t)r * stride, job->image->width);
+        }
+        write_rows(job->bmp, h, count, colors);
+    }
+
+    release_buffer(colors, size);
+}
+
+int load_planar(bmp_file bmp, planar_image *image)
+{
+    if (!validate_bpp(bmp.header.dib.bpp) || !create_planar(image, bmp.header.dib.width, bmp.header.dib.height))
+    {
+        return 0;
+    }
+
+    // Planes missing a band are never handed to the caller
+    planar_job job = {bmp, image, 0};
+    parallel_rows(image->height, load_band, &job);
+    if (job.failed)
+    {
+        free_planar(image);
+        fprintf(stdout, "Photo was not loaded.\n");
+        return 0;
+    }
+    return 1;
+}
+
+int save_planar(bmp_file bmp, const planar_image *image)
+{
+    if (bmp.header.dib.width != image->width || bmp.header.dib.height != image->height)
+    {
+        fprintf(stderr, "The planes are not the same size as the photo.\n");
+        fprintf(stdout, "Photo was not saved.\n");
+        return 0;
+    }
+
+    planar_job job = {bmp, (planar_image *)image, 0};
+    parallel_rows(image->height, save_band, &job);
+    if (job.failed)
+    {
+        fprintf(stdout, "Photo was not saved.\n");
+        return 0;
+    }
+    return 1;
+}
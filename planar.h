@@ -0,0 +1,91 @@
+/**
+ * @file planar.h
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Planar layout of pixels, storing each color channel in its own plane.
+ */
+
+#ifndef PLANAR_H
+#define PLANAR_H
+
+#include "stenography.h"
+
+#define PLANE_ALIGNMENT 64
+
+/**
+ * How the colors of a row of pixels are arranged in memory
+ */
+enum pixel_layout
+{
+    LAYOUT_INTERLEAVED, // blue, green, red of each pixel together, as stored in a bmp
+    LAYOUT_PLANAR       // all blues, then all greens, then all reds
+};
+/**
+ * Rows of pixels with each channel in its own aligned plane
+ */
+typedef struct
+{
+    int width, height;
+    int stride;                      // bytes per row of a plane, a multiple of PLANE_ALIGNMENT
+    unsigned char *planes[CHANNELS]; // aligned to PLANE_ALIGNMENT, indexed by channel
+} planar_image;
+
+/*****************/
+/*** Conversion **/
+/*****************/
+/**
+ * @brief Splits a row of interleaved colors into a row of each plane.
+ * @details Shuffles 16 pixels at a time with SSSE3 when the processor has it, matching the scalar path exactly.
+ * @param colors Interleaved colors of the row.
+ * @param planes Rows of each plane, indexed by channel.
+ * @param width Number of pixels in the row.
+ */
+void deinterleave_row(const unsigned char *restrict colors, unsigned char *restrict planes[CHANNELS], int width);
+/**
+ * @brief Joins a row of each plane into a row of interleaved colors.
+ * @details Shuffles 16 pixels at a time with SSSE3 when the processor has it, matching the scalar path exactly.
+ * @param planes Rows of each plane, indexed by channel.
+ * @param colors Interleaved colors of the row.
+ * @param width Number of pixels in the row.
+ */
+void interleave_row(unsigned char *const restrict planes[CHANNELS], unsigned char *restrict colors, int width);
+/**
+ * @brief Bytes per row of a plane.
+ * @param width Number of pixels in a row.
+ * @return Returns the width padded to a multiple of PLANE_ALIGNMENT.
+ */
+int plane_stride(int width);
+
+/*****************/
+/** Planar Image */
+/*****************/
+/**
+ * @brief Allocates the planes of an image.
+ * @param image Image to allocate.
+ * @param width Number of pixels in a row.
+ * @param height Number of rows.
+ * @return Returns 1 when allocated, 0 when out of memory.
+ */
+int create_planar(planar_image *image, int width, int height);
+/**
+ * @brief Frees the planes of an image.
+ * @param image Image to free.
+ */
+void free_planar(planar_image *image);
+/**
+ * @brief Loads every row of a bmp photo into planes.
+ * @param bmp A bmp photo.
+ * @param image Image to create and fill, freed by the caller with free_planar.
+ * @return Returns 1 when loaded, 0 on failure, when the image is already freed.
+ */
+int load_planar(bmp_file bmp, planar_image *image);
+/**
+ * @brief Saves planes into every row of a bmp photo of the same size.
+ * @param bmp A bmp photo.
+ * @param image Image to save.
+ * @return Returns 1 when saved, 0 on failure, when the bands that could be converted are written.
+ */
+int save_planar(bmp_file bmp, const planar_image *image);
+
+#endif
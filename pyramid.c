@@ -0,0 +1,266 @@
+/**
+ * @file pyramid.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Downscaled copies of a bmp photo built in a single pass over its rows.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pyramid.h"
+#include "parallel.h"
+#include "buffer_pool.h"
+
+#define BATCH_BYTES (1 << 16) // bytes of finished rows held by a level before writing
+
+/**
+ * One downscaled copy of the photo, filled as rows of the level above arrive
+ */
+typedef struct
+{
+    bmp_file bmp;
+    int width, height, stride;
+    int source_width;  // width of the level above
+    uint16_t *pending; // column pair sums of an unpaired row of the level above
+    int has_pending;
+    uint8_t *rows;    // finished rows waiting to be written
+    int batch, count; // rows held by rows, and rows now in it
+    int written;      // rows written to the photo
+    size_t pending_size, rows_size;
+} pyramid_level;
+
+/****************************************/
+/*************** Helpers ****************/
+/****************************************/
+/**
+ * @brief Sums each pair of pixels in a row, the last pixel of an odd row pairs with itself.
+ */
+static void pair_columns(const uint8_t *row, int source_width, int width, uint16_t *sums)
+{
+    for (int x = 0; x < width; x++)
+    {
+        const uint8_t *left = row + 2 * x * sizeof(rgb);
+        const uint8_t *right = 2 * x + 1 < source_width ? left + sizeof(rgb) : left;
+        for (int c = 0; c < CHANNELS; c++)
+        {
+            sums[x * CHANNELS + c] = left[c] + right[c];
+        }
+    }
+}
+
+/**
+ * @brief Writes the finished rows held by a level.
+ */
+static void write_batch(pyramid_level *level)
+{
+    write_rows(level->bmp, level->written, level->count, level->rows);
+    level->written += level->count;
+    level->count = 0;
+}
+
+static void push_row(pyramid_level *levels, int level, int count, const uint8_t *row);
+
+/**
+ * @brief Passes a finished row down to the next level, then holds it for writing.
+ */
+static void finish_row(pyramid_level *levels, int level, int count)
+{
+    pyramid_level *current = &levels[level];
+    push_row(levels, level + 1, count, current->rows + (size_t)current->count * current->stride);
+    if (++current->count == current->batch)
+    {
+        write_batch(current);
+    }
+}
+
+/**
+ * @brief Gives a row of the level above to a level.
+ * @details The first row of each pair is kept as column sums, the second finishes a row.
+ */
+static void push_row(pyramid_level *levels, int level, int count, const uint8_t *row)
+{
+    if (level == count)
+    {
+        return;
+    }
+
+    pyramid_level *current = &levels[level];
+    if (!current->has_pending)
+    {
+        pair_columns(row, current->source_width, current->width, current->pending);
+        current->has_pending = 1;
+        return;
+    }
+
+    // Average the 2x2 block, rounding to nearest
+    uint8_t *out = current->rows + (size_t)current->count * current->stride;
+    for (int x = 0; x < current->width; x++)
+    {
+        const uint8_t *left = row + 2 * x * sizeof(rgb);
+        const uint8_t *right = 2 * x + 1 < current->source_width ? left + sizeof(rgb) : left;
+        for (int c = 0; c < CHANNELS; c++)
+        {
+            out[x * CHANNELS + c] = (current->pending[x * CHANNELS + c] + left[c] + right[c] + 2) >> 2;
+        }
+    }
+    current->has_pending = 0;
+    finish_row(levels, level, count);
+}
+
+/**
+ * @brief Finishes an unpaired last row of a level by pairing it with itself.
+ */
+static void flush_pending(pyramid_level *levels, int level, int count)
+{
+    pyramid_level *current = &levels[level];
+    if (!current->has_pending)
+    {
+        return;
+    }
+
+    uint8_t *out = current->rows + (size_t)current->count * current->stride;
+    for (int v = 0; v < current->width * CHANNELS; v++)
+    {
+        out[v] = (current->pending[v] + 1) >> 1;
+    }
+    current->has_pending = 0;
+    finish_row(levels, level, count);
+}
+
+/**
+ * @brief Releases the buffers of each level and closes its photo.
+ */
+static void close_levels(pyramid_level *levels, int count)
+{
+    for (int l = 0; l < count; l++)
+    {
+        release_buffer(levels[l].pending, levels[l].pending_size);
+        release_buffer(levels[l].rows, levels[l].rows_size);
+        if (levels[l].bmp.photo != NULL)
+        {
+            close_bmp(levels[l].bmp);
+        }
+    }
+}
+
+/**
+ * @brief Creates the photo and buffers of each level.
+ * @return Returns the number of levels opened, 0 on failure.
+ */
+static int open_levels(bmp_file bmp, const char *prefix, int levels, pyramid_level *opened)
+{
+    bmp_header header = bmp.header;
+    int count = 0;
+    int width = header.dib.width, height = header.dib.height;
+    while (count < levels && (width > 1 || height > 1))
+    {
+        pyramid_level *level = &opened[count];
+        memset(level, 0, sizeof(*level));
+        level->source_width = width;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+
+        // Each level halves the pixels and their density
+        bmp_header level_header = header;
+        level_header.dib.width = level->width = width;
+        level_header.dib.height = level->height = height;
+        level_header.dib.hres /= 2;
+        level_header.dib.vres /= 2;
+        level->stride = row_stride(level_header);
+
+        // Creating a level empties its file, so never the photo being read
+        char path[4096];
+        snprintf(path, sizeof(path), "%s_%i.bmp", prefix, 2 << count);
+        if (same_file(bmp, path))
+        {
+            fprintf(stderr, "Level %i of the pyramid would replace the photo at %s.\n", count + 1, path);
+            close_levels(opened, count);
+            return 0;
+        }
+        level->bmp = create_bmp(path, level_header);
+        count++;
+
+        level->batch = BATCH_BYTES / level->stride < 1 ? 1 : BATCH_BYTES / level->stride;
+        level->pending_size = sizeof(uint16_t) * CHANNELS * width;
+        level->rows_size = (size_t)level->batch * level->stride;
+        level->pending = acquire_buffer(level->pending_size);
+        level->rows = acquire_buffer(level->rows_size);
+        if (level->bmp.photo == NULL || level->pending == NULL || level->rows == NULL)
+        {
+            fprintf(stderr, "Level %i of the pyramid could not be created.\n", count);
+            close_levels(opened, count);
+            return 0;
+        }
+
+        // Padding is never written by the rows, so it starts zeroed
+        memset(level->rows, 0, level->rows_size);
+    }
+    return count;
+}
+
+/****************************************/
+/**************** Pyramid ***************/
+/****************************************/
+int build_pyramid(bmp_file bmp, const char *prefix, int levels)
+{
+    if (!validate_bpp(bmp.header.dib.bpp))
+    {
+        fprintf(stdout, "Pyramid was not built.\n");
+        return 0;
+    }
+    if (levels < 1 || levels > MAX_LEVELS)
+    {
+        fprintf(stderr, "Pyramid levels must be from 1 to %i.\n", MAX_LEVELS);
+        fprintf(stdout, "Pyramid was not built.\n");
+        return 0;
+    }
+    if (bmp.header.dib.width < 2 && bmp.header.dib.height < 2)
+    {
+        fprintf(stderr, "The photo is a single pixel and cannot be reduced.\n");
+        fprintf(stdout, "Pyramid was not built.\n");
+        return 0;
+    }
+
+    pyramid_level opened[MAX_LEVELS];
+    int count = open_levels(bmp, prefix, levels, opened);
+    if (count == 0)
+    {
+        fprintf(stdout, "Pyramid was not built.\n");
+        return 0;
+    }
+
+    int stride = row_stride(bmp.header);
+    int rows = band_rows(stride);
+    size_t size = (size_t)rows * stride;
+    uint8_t *band = acquire_buffer(size);
+    if (band == NULL)
+    {
+        fprintf(stderr, "Not enough memory to read the photo.\n");
+        fprintf(stdout, "Pyramid was not built.\n");
+        close_levels(opened, count);
+        return 0;
+    }
+
+    // Stream the photo once, every level fills as its rows arrive
+    for (int h = 0; h < bmp.header.dib.height; h += rows)
+    {
+        int band_rows = bmp.header.dib.height - h < rows ? bmp.header.dib.height - h : rows;
+        read_rows(bmp, h, band_rows, band);
+        for (int r = 0; r < band_rows; r++)
+        {
+            push_row(opened, 0, count, band + (size_t)r * stride);
+        }
+    }
+
+    // Finish odd last rows from the largest level down, then write what is held
+    for (int l = 0; l < count; l++)
+    {
+        flush_pending(opened, l, count);
+        write_batch(&opened[l]);
+    }
+
+    release_buffer(band, size);
+    close_levels(opened, count);
+    return count;
+}
@@ -0,0 +1,30 @@
+/**
+ * @file pyramid.h
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Downscaled copies of a bmp photo built in a single pass over its rows.
+ */
+
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include "stenography.h"
+
+#define MAX_LEVELS 16
+
+/**
+ * @brief Writes copies of a photo at 1/2, 1/4, 1/8 ... of its width and height.
+ * @details Reads the photo once. Each level averages 2x2 blocks of the level above as its
+ *          rows arrive, holding a single unpaired row, so only a few rows per level are kept.
+ *          Odd widths and heights repeat the last column or row, so every pixel is counted.
+ *          Levels stop early once a level is a single pixel.
+ * @param bmp A bmp photo.
+ * @param prefix Start of the level paths, level n is written to <prefix>_<2^n>.bmp.
+ *               Nothing is written when a level path names the photo itself.
+ * @param levels Number of levels to write, from 1 to MAX_LEVELS.
+ * @return Returns the number of levels written, 0 on failure.
+ */
+int build_pyramid(bmp_file bmp, const char *prefix, int levels);
+
+#endif
@@ -0,0 +1,356 @@
+/**
+ * @file scan.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Inventory of the bmp headers below a directory, a quick pre-flight check before a batch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "scan.h"
+#include "stenography.h"
+
+#define SCAN_THREADS 16 // header reads mostly wait on the disk, so more threads than processors
+
+/**
+ * A directory waiting to be walked
+ */
+typedef struct directory
+{
+    struct directory *next;
+    char path[];
+} directory;
+
+/**
+ * A scan shared by every walking thread
+ */
+typedef struct
+{
+    pthread_mutex_t lock;         // guards the pending directories, output, and summary
+    pthread_cond_t pending_ready; // signaled when a directory is pending or walking ends
+    directory *pending;
+    int walking; // threads walking a directory, which may find more directories
+    enum scan_format format;
+    FILE *output;
+    scan_summary summary;
+} scan_job;
+
+/****************************************/
+/**************** Output ****************/
+/****************************************/
+/**
+ * @brief Writes a path as a CSV field, quoted when it holds a comma, quote, or line break.
+ */
+static void write_csv_path(FILE *output, const char *path)
+{
+    if (strpbrk(path, ",\"\r\n") == NULL)
+    {
+        fputs(path, output);
+        return;
+    }
+
+    fputc('"', output);
+    for (const char *c = path; *c; c++)
+    {
+        if (*c == '"')
+        {
+            fputc('"', output);
+        }
+        fputc(*c, output);
+    }
+    fputc('"', output);
+}
+
+/**
+ * @brief Writes a path as a JSON string.
+ */
+static void write_json_path(FILE *output, const char *path)
+{
+    fputc('"', output);
+    for (const unsigned char *c = (const unsigned char *)path; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fprintf(output, "\\%c", *c);
+        }
+        else if (*c < 0x20)
+        {
+            fprintf(output, "\\u%04x", *c);
+        }
+        else
+        {
+            fputc(*c, output);
+        }
+    }
+    fputc('"', output);
+}
+
+/**
+ * @brief Writes the results of one photo, called with the lock held.
+ */
+static void write_photo(scan_job *job, const char *path, const bmp_header *header, long long length, enum header_problem problem)
+{
+    // Header fields are only known once the header was read
+    int read = problem != HEADER_UNREADABLE && problem != HEADER_SHORT;
+
+    if (job->format == SCAN_CSV)
+    {
+        write_csv_path(job->output, path);
+        fprintf(job->output, ",%s", header_problem_name(problem));
+        if (read)
+        {
+            fprintf(job->output, ",%i,%i,%i,%i,%i,%i,%lld\n", header->dib.width, header->dib.height, header->dib.bpp,
+                    header->dib.scheme, header->bitmap.offset, header->bitmap.file_size, length);
+        }
+        else
+        {
+            fprintf(job->output, ",,,,,,,%lld\n", length);
+        }
+        return;
+    }
+
+    fputs(job->summary.photos == 0 ? "\n  {\"path\": " : ",\n  {\"path\": ", job->output);
+    write_json_path(job->output, path);
+    fprintf(job->output, ", \"status\": \"%s\"", header_problem_name(problem));
+    if (read)
+    {
+        fprintf(job->output, ", \"width\": %i, \"height\": %i, \"bpp\": %i, \"compression\": %i, \"offset\": %i, \"file_size\": %i",
+                header->dib.width, header->dib.height, header->dib.bpp, header->dib.scheme, header->bitmap.offset, header->bitmap.file_size);
+    }
+    else
+    {
+        fprintf(job->output, ", \"width\": null, \"height\": null, \"bpp\": null, \"compression\": null, \"offset\": null, \"file_size\": null");
+    }
+    fprintf(job->output, ", \"length\": %lld}", length);
+}
+
+/****************************************/
+/**************** Walking ***************/
+/****************************************/
+/**
+ * @brief Reads, validates, and writes the header of one photo.
+ */
+static void scan_photo(scan_job *job, const char *path)
+{
+    bmp_header header;
+    long long length = 0;
+    enum header_problem problem = HEADER_UNREADABLE;
+
+    // One open, one stat, and one read per photo
+    int file = open(path, O_RDONLY);
+    struct stat status;
+    if (file >= 0 && fstat(file, &status) == 0)
+    {
+        length = status.st_size;
+        problem = read_header(file, &header) ? check_header(header, length) : HEADER_SHORT;
+    }
+    if (file >= 0)
+    {
+        close(file);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    write_photo(job, path, &header, length, problem);
+    job->summary.photos++;
+    job->summary.problems += problem != HEADER_VALID;
+    pthread_mutex_unlock(&job->lock);
+}
+
+/**
+ * @brief Queues a directory for any walking thread.
+ */
+static void push_directory(scan_job *job, const char *path)
+{
+    size_t size = strlen(path) + 1;
+    directory *pending = malloc(sizeof(directory) + size);
+    if (pending == NULL)
+    {
+        fprintf(stderr, "Not enough memory to walk %s.\n", path);
+        return;
+    }
+    memcpy(pending->path, path, size);
+
+    pthread_mutex_lock(&job->lock);
+    pending->next = job->pending;
+    job->pending = pending;
+    pthread_cond_signal(&job->pending_ready);
+    pthread_mutex_unlock(&job->lock);
+}
+
+/**
+ * @brief Checks whether a file name ends in .bmp, ignoring case.
+ */
+static int is_bmp(const char *name)
+{
+    size_t length = strlen(name);
+    return length >= 4 && strcasecmp(name + length - 4, ".bmp") == 0;
+}
+
+/**
+ * @brief Scans the photos of a directory and queues its subdirectories.
+ */
+static void walk_directory(scan_job *job, const char *path)
+{
+    DIR *entries = opendir(path);
+    if (entries == NULL)
+    {
+        fprintf(stderr, "%s not successfully opened.\n", path);
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(entries)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        char child[PATH_MAX];
+        if (snprintf(child, sizeof(child), "%s/%s", path, entry->d_name) >= (int)sizeof(child))
+        {
+            fprintf(stderr, "%s/%s is too long a path.\n", path, entry->d_name);
+            continue;
+        }
+
+        // Most file systems report the type, others need a stat
+        int type = entry->d_type;
+        if (type == DT_UNKNOWN)
+        {
+            struct stat status;
+            if (lstat(child, &status) == 0)
+            {
+                type = S_ISDIR(status.st_mode) ? DT_DIR : S_ISREG(status.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+        }
+
+        if (type == DT_DIR)
+        {
+            push_directory(job, child);
+        }
+        else if (type == DT_REG && is_bmp(entry->d_name))
+        {
+            scan_photo(job, child);
+        }
+    }
+
+    closedir(entries);
+}
+
+/**
+ * @brief Walks pending directories until none are pending and no thread is walking.
+ */
+static void *walk(void *context)
+{
+    scan_job *job = context;
+
+    pthread_mutex_lock(&job->lock);
+    while (1)
+    {
+        // A walking thread may still find more directories
+        while (job->pending == NULL && job->walking > 0)
+        {
+            pthread_cond_wait(&job->pending_ready, &job->lock);
+        }
+        if (job->pending == NULL)
+        {
+            break;
+        }
+
+        directory *next = job->pending;
+        job->pending = next->next;
+        job->walking++;
+        pthread_mutex_unlock(&job->lock);
+
+        walk_directory(job, next->path);
+        free(next);
+
+        pthread_mutex_lock(&job->lock);
+        job->walking--;
+        if (job->walking == 0 && job->pending == NULL)
+        {
+            pthread_cond_broadcast(&job->pending_ready);
+        }
+    }
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+/****************************************/
+/***************** Scan *****************/
+/****************************************/
+int scan_headers(const char *root, enum scan_format format, FILE *output, scan_summary *summary)
+{
+    struct stat status;
+    if (stat(root, &status))
+    {
+        fprintf(stderr, "%s not successfully opened.\n", root);
+        return 0;
+    }
+
+    scan_job job = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, format, output, {0, 0}};
+    fputs(format == SCAN_CSV ? "path,status,width,height,bpp,compression,offset,file_size,length\n" : "[", output);
+
+    if (S_ISDIR(status.st_mode))
+    {
+        // Drop trailing slashes so child paths read cleanly
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s", root);
+        for (size_t length = strlen(path); length > 1 && path[length - 1] == '/'; length--)
+        {
+            path[length - 1] = '\0';
+        }
+        push_directory(&job, path);
+
+        // Walk with helper threads and the calling thread
+        pthread_t threads[SCAN_THREADS - 1];
+        int started = 0;
+        while (started < SCAN_THREADS - 1 && pthread_create(&threads[started], NULL, walk, &job) == 0)
+        {
+            started++;
+        }
+        walk(&job);
+        for (int t = 0; t < started; t++)
+        {
+            pthread_join(threads[t], NULL);
+        }
+    }
+    else
+    {
+        scan_photo(&job, root);
+    }
+
+    if (format == SCAN_JSON)
+    {
+        fputs(job.summary.photos == 0 ? "]\n" : "\n]\n", output);
+    }
+    fflush(output);
+
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.pending_ready);
+    *summary = job.summary;
+    return 1;
+}
+
+int find_scan_format(const char *name, enum scan_format *format)
+{
+    static const char *names[SCAN_FORMATS] = {[SCAN_CSV] = "csv", [SCAN_JSON] = "json"};
+    for (int f = 0; f < SCAN_FORMATS; f++)
+    {
+        if (strcasecmp(name, names[f]) == 0)
+        {
+            *format = f;
+            return 1;
+        }
+    }
+    return 0;
+}
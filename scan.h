@@ -0,0 +1,55 @@
+/**
+ * @file scan.h
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Inventory of the bmp headers below a directory, a quick pre-flight check before a batch.
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdio.h>
+
+/**
+ * Formats of the scan results
+ */
+enum scan_format
+{
+    SCAN_CSV,  // a header line, then one line per photo
+    SCAN_JSON, // an array with one object per photo
+    SCAN_FORMATS
+};
+/**
+ * Totals of a scan
+ */
+typedef struct
+{
+    unsigned long photos;   // bmp files found
+    unsigned long problems; // bmp files whose header failed validation
+} scan_summary;
+
+/**
+ * @brief Reads and validates the header of every bmp file below a directory.
+ * @details Directories are walked by several threads at once and each header is read
+ *          with a single positioned read, so only the first 54 bytes of a photo are touched.
+ *          Files ending in .bmp are scanned, symbolic links are not followed, and photos
+ *          are written in the order they are found.
+ *          Each photo reports its path, status (see header_problem_name), the header fields,
+ *          and the file length.
+ * @param root Directory to walk, or a single bmp file.
+ * @param format Format of the results.
+ * @param output Stream receiving the results.
+ * @param summary Set to the number of photos found and those with problems.
+ * @return Returns 1 when scanned, 0 when root cannot be read.
+ */
+int scan_headers(const char *root, enum scan_format format, FILE *output, scan_summary *summary);
+/**
+ * @brief Finds a scan format by name.
+ * @param name Name of the format, csv or json.
+ * @param format Set to the format when found.
+ * @return Returns 1 when found, 0 otherwise.
+ */
+int find_scan_format(const char *name, enum scan_format *format);
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * @file statistics.h
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Color statistics of a bmp photo and the histogram driven operations built on them.
+ */
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include "stenography.h"
+
+/**
+ * Per channel histogram and summary of a bmp's colors
+ */
+typedef struct
+{
+    unsigned long histogram[CHANNELS][256];
+    unsigned char min[CHANNELS], max[CHANNELS];
+    double mean[CHANNELS];
+    unsigned long pixels;
+} bmp_stats;
+/**
+ * Differences between two photos of the same size
+ */
+typedef struct
+{
+    unsigned long pixels;    // pixels compared
+    unsigned long different; // pixels with a channel that differs
+    int max_difference;      // largest difference of a channel
+    double psnr;             // peak signal to noise ratio in dB, INFINITY when identical
+} bmp_comparison;
+
+/*****************/
+/** Statistics ***/
+/*****************/
+/**
+ * @brief Computes the histogram, minimum, maximum, and mean of each channel.
+ * @details Reads the photo once. Each band of rows fills a private histogram which are merged at the end.
+ * @param bmp A bmp photo.
+ * @param stats Filled with the statistics of the photo.
+ * @return Returns 1 when computed, 0 when the photo is not supported.
+ */
+int compute_stats(bmp_file bmp, bmp_stats *stats);
+/**
+ * @brief Displays the minimum, maximum, and mean of each channel.
+ * @param stats Statistics of a bmp photo.
+ */
+void display_stats(const bmp_stats *stats);
+/**
+ * @brief Displays hints of whether a photo is hidden in the LSbs.
+ * @details A photo hidden by hide() turns the 4 LSbs of each color into the MSbs of a real photo,
+ *          giving them the uneven distribution of a real photo instead of noise.
+ * @param stats Statistics of a bmp photo.
+ */
+void display_lsb_hints(const bmp_stats *stats);
+
+/*****************/
+/** Comparison ***/
+/*****************/
+/**
+ * @brief Compares every color of two photos of the same size.
+ * @details Each band of rows reads both photos and counts its own differences, which are summed at the end.
+ *          Padding is ignored, so only the colors decide whether two photos match.
+ * @param first A bmp photo.
+ * @param second A bmp photo of the same size.
+ * @param comparison Filled with the differences between the photos.
+ * @return Returns 1 when compared, 0 when the photos are not supported or differ in size.
+ */
+int compare_photos(bmp_file first, bmp_file second, bmp_comparison *comparison);
+/**
+ * @brief Displays the differences between two photos.
+ * @param comparison Differences between two photos.
+ */
+void display_comparison(const bmp_comparison *comparison);
+
+/*****************/
+/** Adjust BMP ***/
+/*****************/
+/**
+ * @brief Replaces every color through a per channel lookup table.
+ * @param bmp A bmp photo to alter.
+ * @param lut The new value of each color, indexed by channel then old value.
+ */
+void apply_lut(bmp_file bmp, unsigned char lut[CHANNELS][256]);
+/**
+ * @brief Stretches each channel so its colors span from 0 to 255.
+ * @param bmp A bmp photo to alter.
+ */
+void auto_contrast(bmp_file bmp);
+/**
+ * @brief Equalizes the histogram of each channel.
+ * @details Maps each color through the cumulative distribution of its channel.
+ * @param bmp A bmp photo to alter.
+ */
+void equalize(bmp_file bmp);
+
+#endif
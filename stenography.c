@@ -9,7 +9,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
 #include "stenography.h"
+#include "buffer_pool.h"
 
 /****************************************/
 /*************** BMP File ***************/
@@ -28,9 +32,8 @@ bmp_file open_bmp(const char *filename)
         return bmp;
     }
 
-    // check proper file type
-    checked_read(bmp.header.bitmap.id, sizeof(bmp.header.bitmap.id), 1, bmp.photo);
-    if (strncmp(bmp.header.bitmap.id, "BM", 2))
+    // Read the whole header at once and check proper file type
+    if (!read_header(fileno(bmp.photo), &bmp.header) || strncmp(bmp.header.bitmap.id, "BM", 2))
     {
         fprintf(stderr, "%s is the incorrect file type.\n", filename);
 
@@ -40,24 +43,63 @@ bmp_file open_bmp(const char *filename)
         return bmp;
     }
 
-    // Set bitmap file header values
-    checked_read(&bmp.header.bitmap.file_size, sizeof(bmp.header.bitmap.file_size), 1, bmp.photo);
-    checked_read(&bmp.header.bitmap.reserved1, sizeof(bmp.header.bitmap.reserved1), 1, bmp.photo);
-    checked_read(&bmp.header.bitmap.reserved2, sizeof(bmp.header.bitmap.reserved2), 1, bmp.photo);
-    checked_read(&bmp.header.bitmap.offset, sizeof(bmp.header.bitmap.offset), 1, bmp.photo);
-
-    // Set DIB header values
-    checked_read(&bmp.header.dib.header_size, sizeof(bmp.header.dib.header_size), 1, bmp.photo);
-    checked_read(&bmp.header.dib.width, sizeof(bmp.header.dib.width), 1, bmp.photo);
-    checked_read(&bmp.header.dib.height, sizeof(bmp.header.dib.height), 1, bmp.photo);
-    checked_read(&bmp.header.dib.planes, sizeof(bmp.header.dib.planes), 1, bmp.photo);
-    checked_read(&bmp.header.dib.bpp, sizeof(bmp.header.dib.bpp), 1, bmp.photo);
-    checked_read(&bmp.header.dib.scheme, sizeof(bmp.header.dib.scheme), 1, bmp.photo);
-    checked_read(&bmp.header.dib.img_size, sizeof(bmp.header.dib.img_size), 1, bmp.photo);
-    checked_read(&bmp.header.dib.hres, sizeof(bmp.header.dib.hres), 1, bmp.photo);
-    checked_read(&bmp.header.dib.vres, sizeof(bmp.header.dib.vres), 1, bmp.photo);
-    checked_read(&bmp.header.dib.num_colors, sizeof(bmp.header.dib.num_colors), 1, bmp.photo);
-    checked_read(&bmp.header.dib.num_imp_colors, sizeof(bmp.header.dib.num_imp_colors), 1, bmp.photo);
+    // Reject headers whose rows would be read outside the file, other color densities are
+    // left for each operation to refuse so their headers may still be displayed
+    struct stat status;
+    enum header_problem problem = fstat(fileno(bmp.photo), &status) ? HEADER_UNREADABLE : check_header(bmp.header, status.st_size);
+    if (problem != HEADER_VALID && problem != HEADER_BPP)
+    {
+        fprintf(stderr, "%s has an invalid header: %s.\n", filename, header_problem_name(problem));
+
+        // close the file
+        close_bmp(bmp);
+        bmp.photo = NULL;
+        return bmp;
+    }
+
+    return bmp;
+}
+
+bmp_file create_bmp(const char *filename, bmp_header header)
+{
+    bmp_file bmp;
+
+    // Header of an uncompressed 24 bpp photo with a 40 byte DIB header and no palette,
+    // whatever the color density of the photo the header came from
+    memcpy(header.bitmap.id, "BM", 2);
+    header.bitmap.offset = HEADER_SIZE;
+    header.dib.header_size = 40;
+    header.dib.planes = 1;
+    header.dib.bpp = 24;
+    header.dib.scheme = 0;
+    header.dib.num_colors = 0;
+    header.dib.num_imp_colors = 0;
+
+    header.dib.img_size = row_stride(header) * header.dib.height;
+    header.bitmap.file_size = header.bitmap.offset + header.dib.img_size;
+    bmp.header = header;
+
+    // Create file
+    bmp.photo = fopen(filename, "w+");
+    if (bmp.photo == NULL)
+    {
+        fprintf(stderr, "%s not successfully created.\n", filename);
+        return bmp;
+    }
+
+    // Write the whole header at once
+    uint8_t bytes[HEADER_SIZE];
+    encode_header(header, bytes);
+    if (pwrite(fileno(bmp.photo), bytes, HEADER_SIZE, 0) != HEADER_SIZE)
+    {
+        fprintf(stderr, "%s header was not written.\n", filename);
+    }
+
+    // Size the pixel array so rows may be written in any order
+    if (ftruncate(fileno(bmp.photo), header.bitmap.file_size))
+    {
+        fprintf(stderr, "%s could not be sized for its pixels.\n", filename);
+    }
 
     return bmp;
 }
@@ -67,6 +109,16 @@ void close_bmp(bmp_file bmp)
     fclose(bmp.photo);
 }
 
+int same_file(bmp_file bmp, const char *path)
+{
+    struct stat opened, named;
+    if (fstat(fileno(bmp.photo), &opened) || stat(path, &named))
+    {
+        return 0;
+    }
+    return opened.st_dev == named.st_dev && opened.st_ino == named.st_ino;
+}
+
 void display_header(bmp_file bmp)
 {
     // Print BMP header details
@@ -92,90 +144,57 @@ void display_header(bmp_file bmp)
     fprintf(stdout, "# important colors: %i\n", bmp.header.dib.num_imp_colors);
 }
 
-void reveal(bmp_file bmp)
+int reveal(bmp_file bmp)
 {
     // Determine RGB Format
     if (bmp.header.dib.bpp != 24)
     {
         fprintf(stderr, "Program does not handle alternate color densities. Image must be 24 bpp.\n");
         fprintf(stdout, "Photo not revealed.\n");
-        return;
+        return 0;
     }
 
-    // Create a color structure
-    rgb color;
-
-    // Update the photo's colors
-    checked_seek(bmp.photo, bmp.header.bitmap.offset, SEEK_SET); // seek to colors
-    int padding = (sizeof(rgb) * bmp.header.dib.width) % 4;      // Padding, align row to multiple of 4
-    for (int h = 0; h < bmp.header.dib.height; h++)
+    // Update the photo's colors a row at a time
+    int colors = sizeof(rgb) * bmp.header.dib.width;
+    int stride = row_stride(bmp.header);
+    uint8_t *row = acquire_buffer(stride);
+    if (row == NULL)
     {
-        for (int w = 0; w < bmp.header.dib.width; w++)
-        {
-            // Read the next color
-            checked_read(&color, sizeof(color.r), 3, bmp.photo);
-
-            // Swap bits of the color
-            color.r = swap_bits(color.r);
-            color.g = swap_bits(color.g);
-            color.b = swap_bits(color.b);
-
-            // Write to the photo
-            checked_seek(bmp.photo, -sizeof(rgb), SEEK_CUR);
-            fwrite(&color, sizeof(rgb), 1, bmp.photo);
-        }
-
-        // End of row padding
-        checked_seek(bmp.photo, padding, SEEK_CUR);
-    }
-}
-
-void peek(bmp_file bmp)
-{
-    // Determine RGB Format
-    if (bmp.header.dib.bpp != 24)
-    {
-        fprintf(stderr, "Program does not handle alternate color densities. Image must be 24 bpp.\n");
+        fprintf(stderr, "Not enough memory for a row of the photo.\n");
         fprintf(stdout, "Photo not revealed.\n");
-        return;
+        return 0;
     }
-
-    // Create a color structure
-    rgb color;
-
-    // Update the photo's colors
-    checked_seek(bmp.photo, bmp.header.bitmap.offset, SEEK_SET); // seek to colors
-    int padding = (sizeof(rgb) * bmp.header.dib.width) % 4;      // Padding, align row to multiple of 4
     for (int h = 0; h < bmp.header.dib.height; h++)
     {
-        for (int w = 0; w < bmp.header.dib.width; w++)
-        {
-            // Read the next color
-            checked_read(&color, sizeof(color), 3, bmp.photo);
-
-            // Swap bits of the color
-            color.r = swap_bits(color.r);
-            color.g = swap_bits(color.g);
-            color.b = swap_bits(color.b);
+        read_rows(bmp, h, 1, row);
 
-            // Write to the photo
-            checked_seek(bmp.photo, -sizeof(rgb), SEEK_CUR);
-            fwrite(&color, sizeof(rgb), 1, bmp.photo);
+        // Swap bits of each color
+        for (int i = 0; i < colors; i++)
+        {
+            row[i] = swap_bits(row[i]);
         }
 
-        // End of row padding
-        checked_seek(bmp.photo, padding, SEEK_CUR);
+        write_rows(bmp, h, 1, row);
     }
+
+    release_buffer(row, stride);
+    return 1;
+}
+
+int peek(bmp_file bmp)
+{
+    // Peeking swaps the same bits as revealing
+    return reveal(bmp);
 }
 
-void hide(bmp_file host, bmp_file hidden)
+int hide(bmp_file host, bmp_file hidden)
 {
     // Determine RGB Format
     if (host.header.dib.bpp != 24 || hidden.header.dib.bpp != 24)
     {
         fprintf(stderr, "Program does not handle alternate color densities. Image must be 24 bpp.\n");
         fprintf(stdout, "Photo not revealed.\n");
-        return;
+        return 0;
     }
 
     // Make sure same size
@@ -184,39 +203,39 @@ void hide(bmp_file host, bmp_file hidden)
     {
         fprintf(stderr, "The two photos are not the same size. Images must be the same height and width.\n");
         fprintf(stdout, "Photo not stored.\n");
-        return;
+        return 0;
     }
 
-    // Create a color structure
-    rgb host_color;
-    rgb hidden_color;
-
-    // Update the photo's colors
-    checked_seek(host.photo, host.header.bitmap.offset, SEEK_SET); // seek to colors
-    checked_seek(hidden.photo, hidden.header.bitmap.offset, SEEK_SET);
-
-    int padding = (sizeof(host_color) * host.header.dib.width) % 4; // Padding, align row to multiple of 4
-    for (int h = 0; h < host.header.dib.height; h++)                // padding, height, and width are the same for each photo
+    // Update the photo's colors a row at a time, rows are the same size for each photo
+    int colors = sizeof(rgb) * host.header.dib.width;
+    int stride = row_stride(host.header);
+    uint8_t *host_row = acquire_buffer(stride);
+    uint8_t *hidden_row = acquire_buffer(stride);
+    if (host_row == NULL || hidden_row == NULL)
+    {
+        fprintf(stderr, "Not enough memory for a row of the photos.\n");
+        fprintf(stdout, "Photo not stored.\n");
+        release_buffer(host_row, stride);
+        release_buffer(hidden_row, stride);
+        return 0;
+    }
+    for (int h = 0; h < host.header.dib.height; h++)
     {
-        for (int w = 0; w < host.header.dib.width; w++)
+        read_rows(host, h, 1, host_row);
+        read_rows(hidden, h, 1, hidden_row);
+
+        // Combine bits of each color
+        for (int i = 0; i < colors; i++)
         {
-            // Read the next color
-            checked_read(&host_color, sizeof(host_color.r), 3, host.photo);
-            checked_read(&hidden_color, sizeof(hidden_color.r), 3, hidden.photo);
-
-            // Swap bits of  color
-            host_color.r = combine_bits(host_color.r, hidden_color.r);
-            host_color.g = combine_bits(host_color.g, hidden_color.g);
-            host_color.b = combine_bits(host_color.b, hidden_color.b);
-
-            // Write to the photo
-            checked_seek(host.photo, -sizeof(host_color), SEEK_CUR);
-            fwrite(&host_color, sizeof(host_color), 1, host.photo);
+            host_row[i] = combine_bits(host_row[i], hidden_row[i]);
         }
 
-        // End of row padding
-        checked_seek(host.photo, padding, SEEK_CUR);
+        write_rows(host, h, 1, host_row);
     }
+
+    release_buffer(host_row, stride);
+    release_buffer(hidden_row, stride);
+    return 1;
 }
 
 void invert(bmp_file bmp)
@@ -228,32 +247,30 @@ void invert(bmp_file bmp)
         return;
     }
 
-    // Create a color structure
-    rgb color;
-
-    // Update the photo's colors
-    checked_seek(bmp.photo, bmp.header.bitmap.offset, SEEK_SET); // jump to pixels
-    int padding = (sizeof(rgb) * bmp.header.dib.width) % 4;      // padding aligns row to multiple of 4
+    // Update the photo's colors a row at a time
+    int colors = sizeof(rgb) * bmp.header.dib.width;
+    int stride = row_stride(bmp.header);
+    uint8_t *row = acquire_buffer(stride);
+    if (row == NULL)
+    {
+        fprintf(stderr, "Not enough memory for a row of the photo.\n");
+        fprintf(stdout, "Photo was not inverted.\n");
+        return;
+    }
     for (int h = 0; h < bmp.header.dib.height; h++)
     {
-        for (int w = 0; w < bmp.header.dib.width; w++)
-        {
-            // Read the next color
-            checked_read(&color, sizeof(color.r), 3, bmp.photo);
-
-            // Invert the color
-            color.r = invert_bits(color.r);
-            color.g = invert_bits(color.g);
-            color.b = invert_bits(color.b);
+        read_rows(bmp, h, 1, row);
 
-            // Write to the photo
-            checked_seek(bmp.photo, -sizeof(rgb), SEEK_CUR);
-            fwrite(&color, sizeof(rgb), 1, bmp.photo);
+        // Invert each color
+        for (int i = 0; i < colors; i++)
+        {
+            row[i] = invert_bits(row[i]);
         }
 
-        // End of row padding
-        checked_seek(bmp.photo, padding, SEEK_CUR);
+        write_rows(bmp, h, 1, row);
     }
+
+    release_buffer(row, stride);
 }
 
 void grayscale(bmp_file bmp)
@@ -261,41 +278,44 @@ void grayscale(bmp_file bmp)
     // Validate bits per pixel
     if (!validate_bpp(bmp.header.dib.bpp))
     {
-        fprintf(stdout, "Photo was not inverted.\n");
+        fprintf(stdout, "Photo was not converted to grayscale.\n");
+        return;
+    }
+
+    // Update the photo's colors a row at a time
+    int stride = row_stride(bmp.header);
+    uint8_t *row = acquire_buffer(stride);
+    if (row == NULL)
+    {
+        fprintf(stderr, "Not enough memory for a row of the photo.\n");
+        fprintf(stdout, "Photo was not converted to grayscale.\n");
         return;
     }
 
-    // Update the photo's colors
-    rgb color;
-    checked_seek(bmp.photo, bmp.header.bitmap.offset, SEEK_SET); // jump to pixel array
-    int padding = (sizeof(color) * bmp.header.dib.width) % 4;    // row padding aligns to multiple of 4
+    rgb *pixels = (rgb *)row;
     for (int h = 0; h < bmp.header.dib.height; h++)
     {
+        read_rows(bmp, h, 1, row);
+
         for (int w = 0; w < bmp.header.dib.width; w++)
         {
-            // Read the next color
-            checked_read(&color, sizeof(color.r), 3, bmp.photo);
-
             // Linearize the normalized color
-            double r_lin = linearize(color.r);
-            double g_lin = linearize(color.g);
-            double b_lin = linearize(color.b);
+            double r_lin = linearize(pixels[w].r);
+            double g_lin = linearize(pixels[w].g);
+            double b_lin = linearize(pixels[w].b);
 
             // Calculate luminance
             double luminance = 0.2126 * r_lin + 0.7152 * g_lin + 0.0722 * b_lin;
 
             // Delinearize and set colors to grayscale
-            unsigned char gray_color = delinearize(luminance);
-            color.r = gray_color, color.g = gray_color, color.b = gray_color;
-
-            // Write to the photo
-            checked_seek(bmp.photo, -sizeof(color), SEEK_CUR);
-            fwrite(&color, sizeof(color), 1, bmp.photo);
+            uint8_t gray_color = delinearize(luminance);
+            pixels[w].r = gray_color, pixels[w].g = gray_color, pixels[w].b = gray_color;
         }
 
-        // End of row padding
-        checked_seek(bmp.photo, padding, SEEK_CUR);
+        write_rows(bmp, h, 1, row);
     }
+
+    release_buffer(row, stride);
 }
 
 void hflip_image(bmp_file bmp)
@@ -307,31 +327,33 @@ void hflip_image(bmp_file bmp)
         return;
     }
 
-    checked_seek(bmp.photo, bmp.header.bitmap.offset, SEEK_SET); // jump to pixels
-    int row_size = bmp.header.dib.width * sizeof(rgb);
-    rgb row[bmp.header.dib.width];
-    int padding = row_size % 4; // padding aligns row to multiple of 4
+    int width = bmp.header.dib.width;
+    int stride = row_stride(bmp.header);
+    uint8_t *row = acquire_buffer(stride);
+    if (row == NULL)
+    {
+        fprintf(stderr, "Not enough memory for a row of the photo.\n");
+        fprintf(stdout, "Photo was not flipped.\n");
+        return;
+    }
 
+    rgb *pixels = (rgb *)row;
     for (int h = 0; h < bmp.header.dib.height; h++)
     {
         // Store the entire row
-        checked_read(row, sizeof(rgb), bmp.header.dib.width, bmp.photo);
+        read_rows(bmp, h, 1, row);
 
         // Swap the colors
-        for (int w = 0; w < bmp.header.dib.width / 2; w++)
+        for (int w = 0; w < width / 2; w++)
         {
-            printf("Before Swap: %d %d %d - %d %d %d\n", row[w].r, row[w].g, row[w].b, row[bmp.header.dib.width - w - 1].r, row[bmp.header.dib.width - w - 1].g, row[bmp.header.dib.width - w - 1].b);
-            swap(&row[w], &row[bmp.header.dib.width - w - 1]);
-            printf("After Swap: %d %d %d - %d %d %d\n", row[w].r, row[w].g, row[w].b, row[bmp.header.dib.width - w - 1].r, row[bmp.header.dib.width - w - 1].g, row[bmp.header.dib.width - w - 1].b);
+            swap(&pixels[w], &pixels[width - w - 1]);
         }
 
         // Write to the photo
-        checked_seek(bmp.photo, -row_size, SEEK_CUR);
-        fwrite(&row, row_size, 1, bmp.photo);
-
-        // Add the end of row padding
-        checked_seek(bmp.photo, padding, SEEK_CUR);
+        write_rows(bmp, h, 1, row);
     }
+
+    release_buffer(row, stride);
 }
 
 void mirror(bmp_file bmp)
@@ -343,29 +365,33 @@ void mirror(bmp_file bmp)
         return;
     }
 
-    checked_seek(bmp.photo, bmp.header.bitmap.offset, SEEK_SET); // jump to pixels
-    int row_size = bmp.header.dib.width * sizeof(rgb);
-    rgb row[bmp.header.dib.width];
-    int padding = row_size % 4; // padding aligns row to multiple of 4
+    int width = bmp.header.dib.width;
+    int stride = row_stride(bmp.header);
+    uint8_t *row = acquire_buffer(stride);
+    if (row == NULL)
+    {
+        fprintf(stderr, "Not enough memory for a row of the photo.\n");
+        fprintf(stdout, "Photo was not flipped.\n");
+        return;
+    }
 
+    rgb *pixels = (rgb *)row;
     for (int h = 0; h < bmp.header.dib.height; h++)
     {
         // Store the entire row
-        checked_read(row, sizeof(rgb), bmp.header.dib.width, bmp.photo);
+        read_rows(bmp, h, 1, row);
 
         // Copy the colors
-        for (int w = 0; w < bmp.header.dib.width / 2; w++)
+        for (int w = 0; w < width / 2; w++)
         {
-            copy(&row[w], &row[bmp.header.dib.width - w - 1]);
+            copy(&pixels[w], &pixels[width - w - 1]);
         }
 
         // Write to the photo
-        checked_seek(bmp.photo, -row_size, SEEK_CUR);
-        fwrite(&row, row_size, 1, bmp.photo);
-
-        // Add the end of row padding
-        checked_seek(bmp.photo, padding, SEEK_CUR);
+        write_rows(bmp, h, 1, row);
     }
+
+    release_buffer(row, stride);
 }
 
 /****************************************/
@@ -383,35 +409,19 @@ void copy(rgb *color1, rgb *color2)
     *color2 = *color1;
 }
 
-char swap_bits(char color)
+uint8_t swap_bits(uint8_t color)
 {
-    unsigned char msb, lsb, temp; // avoid signed ext
-
-    // split color
-    msb = 0xF0 & color;
-    lsb = 0x0F & color;
-
-    // switch order
-    temp = msb;
-    msb = lsb << 4;
-    lsb = temp >> 4; // 1111MSB
-    return lsb | msb;
+    // the MSbs become the LSbs and the LSbs become the MSbs
+    return (uint8_t)(color << 4 | color >> 4);
 }
 
-char combine_bits(char color1, char color2)
+uint8_t combine_bits(uint8_t color1, uint8_t color2)
 {
-    unsigned char msb, lsb; // avoid signed extention
-
-    // capture MSB of each color
-    msb = 0xF0 & color1;
-    lsb = 0xF0 & color2;
-
-    // combine colors
-    lsb = lsb >> 4;
-    return msb | lsb;
+    // MSbs of color1 followed by the MSbs of color2
+    return (color1 & 0xF0) | color2 >> 4;
 }
 
-char invert_bits(char color)
+uint8_t invert_bits(uint8_t color)
 {
     return ~color;
 }
@@ -419,7 +429,7 @@ char invert_bits(char color)
 /*****************************/
 /* Compression and Expansion */
 /*****************************/
-double linearize(unsigned char color)
+double linearize(uint8_t color)
 {
     // Normalize, convert to the sRGB colorspace
     double color_lin = (double)(color / 255.0);
@@ -435,7 +445,7 @@ double linearize(unsigned char color)
     }
 }
 
-unsigned char delinearize(double color_lin)
+uint8_t delinearize(double color_lin)
 {
     // Delinearize
     if (color_lin <= 0.0031308)
@@ -448,7 +458,7 @@ unsigned char delinearize(double color_lin)
     }
 
     // Denormalize, convert to the RGB colorspace
-    return (unsigned char)(color_lin * 255);
+    return (uint8_t)(color_lin * 255);
 }
 
 /****************************************/
@@ -503,6 +513,129 @@ void checked_seek(FILE *file, long int offset, int whence)
     }
 }
 
+int row_stride(bmp_header header)
+{
+    return (sizeof(rgb) * header.dib.width + 3) & ~3;
+}
+
+void read_rows(bmp_file bmp, int row, int count, uint8_t *buffer)
+{
+    size_t size = (size_t)row_stride(bmp.header) * count;
+    off_t offset = bmp.header.bitmap.offset + (off_t)row * row_stride(bmp.header);
+
+    // positioned read, safe to call from several threads at once
+    fflush(bmp.photo);
+    size_t total = 0;
+    while (total < size)
+    {
+        ssize_t read = pread(fileno(bmp.photo), buffer + total, size - total, offset + total);
+        if (read <= 0)
+        {
+            fprintf(stderr, total == 0 ? "No elements were read.\n" : "Not all elements were read.\n");
+            return;
+        }
+        total += read;
+    }
+}
+
+void write_rows(bmp_file bmp, int row, int count, uint8_t *buffer)
+{
+    size_t size = (size_t)row_stride(bmp.header) * count;
+    off_t offset = bmp.header.bitmap.offset + (off_t)row * row_stride(bmp.header);
+
+    // positioned write, safe to call from several threads at once
+    fflush(bmp.photo);
+    size_t total = 0;
+    while (total < size)
+    {
+        ssize_t written = pwrite(fileno(bmp.photo), buffer + total, size - total, offset + total);
+        if (written <= 0)
+        {
+            fprintf(stderr, total == 0 ? "No elements were written.\n" : "Not all elements were written.\n");
+            return;
+        }
+        total += written;
+    }
+}
+
+/**
+ * @brief Copies a field out of the stored header.
+ * @return Returns the bytes following the field.
+ */
+static const uint8_t *take_field(void *field, size_t size, const uint8_t *bytes)
+{
+    memcpy(field, bytes, size);
+    return bytes + size;
+}
+
+/**
+ * @brief Copies a field into the stored header.
+ * @return Returns the bytes following the field.
+ */
+static uint8_t *put_field(const void *field, size_t size, uint8_t *bytes)
+{
+    memcpy(bytes, field, size);
+    return bytes + size;
+}
+
+void decode_header(const uint8_t bytes[HEADER_SIZE], bmp_header *header)
+{
+    // Bitmap file header values
+    bytes = take_field(header->bitmap.id, sizeof(header->bitmap.id), bytes);
+    bytes = take_field(&header->bitmap.file_size, sizeof(header->bitmap.file_size), bytes);
+    bytes = take_field(&header->bitmap.reserved1, sizeof(header->bitmap.reserved1), bytes);
+    bytes = take_field(&header->bitmap.reserved2, sizeof(header->bitmap.reserved2), bytes);
+    bytes = take_field(&header->bitmap.offset, sizeof(header->bitmap.offset), bytes);
+
+    // DIB header values
+    bytes = take_field(&header->dib.header_size, sizeof(header->dib.header_size), bytes);
+    bytes = take_field(&header->dib.width, sizeof(header->dib.width), bytes);
+    bytes = take_field(&header->dib.height, sizeof(header->dib.height), bytes);
+    bytes = take_field(&header->dib.planes, sizeof(header->dib.planes), bytes);
+    bytes = take_field(&header->dib.bpp, sizeof(header->dib.bpp), bytes);
+    bytes = take_field(&header->dib.scheme, sizeof(header->dib.scheme), bytes);
+    bytes = take_field(&header->dib.img_size, sizeof(header->dib.img_size), bytes);
+    bytes = take_field(&header->dib.hres, sizeof(header->dib.hres), bytes);
+    bytes = take_field(&header->dib.vres, sizeof(header->dib.vres), bytes);
+    bytes = take_field(&header->dib.num_colors, sizeof(header->dib.num_colors), bytes);
+    take_field(&header->dib.num_imp_colors, sizeof(header->dib.num_imp_colors), bytes);
+}
+
+void encode_header(bmp_header header, uint8_t bytes[HEADER_SIZE])
+{
+    // Bitmap file header values
+    bytes = put_field(header.bitmap.id, sizeof(header.bitmap.id), bytes);
+    bytes = put_field(&header.bitmap.file_size, sizeof(header.bitmap.file_size), bytes);
+    bytes = put_field(&header.bitmap.reserved1, sizeof(header.bitmap.reserved1), bytes);
+    bytes = put_field(&header.bitmap.reserved2, sizeof(header.bitmap.reserved2), bytes);
+    bytes = put_field(&header.bitmap.offset, sizeof(header.bitmap.offset), bytes);
+
+    // DIB header values
+    bytes = put_field(&header.dib.header_size, sizeof(header.dib.header_size), bytes);
+    bytes = put_field(&header.dib.width, sizeof(header.dib.width), bytes);
+    bytes = put_field(&header.dib.height, sizeof(header.dib.height), bytes);
+    bytes = put_field(&header.dib.planes, sizeof(header.dib.planes), bytes);
+    bytes = put_field(&header.dib.bpp, sizeof(header.dib.bpp), bytes);
+    bytes = put_field(&header.dib.scheme, sizeof(header.dib.scheme), bytes);
+    bytes = put_field(&header.dib.img_size, sizeof(header.dib.img_size), bytes);
+    bytes = put_field(&header.dib.hres, sizeof(header.dib.hres), bytes);
+    bytes = put_field(&header.dib.vres, sizeof(header.dib.vres), bytes);
+    bytes = put_field(&header.dib.num_colors, sizeof(header.dib.num_colors), bytes);
+    put_field(&header.dib.num_imp_colors, sizeof(header.dib.num_imp_colors), bytes);
+}
+
+int read_header(int file, bmp_header *header)
+{
+    uint8_t bytes[HEADER_SIZE];
+    if (pread(file, bytes, HEADER_SIZE, 0) != HEADER_SIZE)
+    {
+        return 0;
+    }
+
+    decode_header(bytes, header);
+    return 1;
+}
+
 /****************************************/
 /************** Validation **************/
 /****************************************/
@@ -515,4 +648,57 @@ int validate_bpp(int bpp)
         return 0;
     }
     return 1;
-}
\ No newline at end of file
+}
+
+enum header_problem check_header(bmp_header header, long long length)
+{
+    if (strncmp(header.bitmap.id, "BM", 2))
+    {
+        return HEADER_MAGIC;
+    }
+    // Bound the DIB header by the file before adding it to the bitmap file header
+    if (header.dib.header_size < HEADER_SIZE - BITMAP_HEADER_SIZE || header.dib.header_size > length - BITMAP_HEADER_SIZE)
+    {
+        return HEADER_DIB_SIZE;
+    }
+    if (header.dib.width <= 0 || header.dib.height <= 0 || header.dib.width > (INT_MAX - 3) / (int)sizeof(rgb))
+    {
+        return HEADER_DIMENSIONS;
+    }
+    if (header.dib.bpp != 24)
+    {
+        return HEADER_BPP;
+    }
+    if (header.dib.scheme != 0)
+    {
+        return HEADER_COMPRESSION;
+    }
+
+    // Pixels start after both headers and end within the file
+    if (header.bitmap.offset < BITMAP_HEADER_SIZE + (long long)header.dib.header_size || header.bitmap.offset > length)
+    {
+        return HEADER_OFFSET;
+    }
+    if ((long long)row_stride(header) * header.dib.height > length - header.bitmap.offset)
+    {
+        return HEADER_TRUNCATED;
+    }
+    return HEADER_VALID;
+}
+
+const char *header_problem_name(enum header_problem problem)
+{
+    static const char *names[HEADER_PROBLEMS] = {
+        [HEADER_VALID] = "valid",
+        [HEADER_UNREADABLE] = "unreadable",
+        [HEADER_SHORT] = "short",
+        [HEADER_MAGIC] = "magic",
+        [HEADER_DIB_SIZE] = "dib_size",
+        [HEADER_DIMENSIONS] = "dimensions",
+        [HEADER_BPP] = "bpp",
+        [HEADER_COMPRESSION] = "compression",
+        [HEADER_OFFSET] = "offset",
+        [HEADER_TRUNCATED] = "truncated",
+    };
+    return problem >= 0 && problem < HEADER_PROBLEMS ? names[problem] : "unknown";
+}
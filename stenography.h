@@ -6,7 +6,14 @@
  * @brief bmp structure and functions for image stenography and manipulation.
  */
 
+#ifndef STENOGRAPHY_H
+#define STENOGRAPHY_H
+
 #include <stdio.h>
+#include <stdint.h>
+
+#define HEADER_SIZE 54        // bytes of a bitmap file header and a 40 byte DIB header
+#define BITMAP_HEADER_SIZE 14 // bytes of the bitmap file header alone
 
 /**
  * The contents of a bmp's bitmap header
@@ -44,28 +51,75 @@ typedef struct
     FILE *photo;
 } bmp_file;
 /**
- * Red/Green/Blue color
+ * Red/Green/Blue color, stored in a bmp as blue, green, then red
  */
 typedef struct
 {
-    char r, g, b;
+    uint8_t b, g, r;
 } rgb;
+/**
+ * Problems found in the header of a bmp file, in the order they are checked
+ */
+enum header_problem
+{
+    HEADER_VALID,
+    HEADER_UNREADABLE,  // the file could not be opened
+    HEADER_SHORT,       // the file is shorter than a header
+    HEADER_MAGIC,       // the file does not start with BM
+    HEADER_DIB_SIZE,    // the DIB header is smaller than 40 bytes or larger than the file
+    HEADER_DIMENSIONS,  // the width or height is not positive or too large
+    HEADER_BPP,         // the photo is not 24 bpp
+    HEADER_COMPRESSION, // the pixels are compressed
+    HEADER_OFFSET,      // the pixels start within the headers or past the end of the file
+    HEADER_TRUNCATED,   // the pixels run past the end of the file
+    HEADER_PROBLEMS
+};
+/**
+ * Order of the color channels within a stored pixel
+ */
+enum channel
+{
+    CHANNEL_BLUE,
+    CHANNEL_GREEN,
+    CHANNEL_RED,
+    CHANNELS
+};
 
 /*****************/
 /*** BMP File ****/
 /*****************/
 /**
  * @brief Stores a bmp photo in the bmp_file structure.
+ * @details The header is checked with check_header() against the length of the file,
+ *          so every row of an opened 24 bpp photo lies within the file.
  * @param filename The name of the bmp file.
  * @return Returns a bmp_file structure created from the photo.
- *          bmp.photo set to NULL when incompatible file.
+ *          bmp.photo set to NULL when incompatible file or invalid header.
  */
 bmp_file open_bmp(const char *filename);
+/**
+ * @brief Creates a 24 bpp bmp file with the size and resolution of a header.
+ * @details Writes a 54 byte header of an uncompressed 24 bpp photo and sizes the file for its
+ *          pixels, which start zeroed.
+ * @param filename The name of the bmp file, replaced when it exists, so never the photo being read.
+ * @param header Header whose width, positive height, and resolution are used, as accepted by check_header().
+ * @return Returns a bmp_file structure for the new photo.
+ *          bmp.photo set to NULL when the file cannot be created.
+ */
+bmp_file create_bmp(const char *filename, bmp_header header);
 /**
  * @brief Closes the bmp file.
  * @param bmp bmp file to close
  */
 void close_bmp(bmp_file bmp);
+/**
+ * @brief Checks whether an open photo and a path name the same file, however the path is spelled.
+ * @details Compares devices and inodes, so ./photo.bmp and links to the photo match it.
+ * @param bmp An open bmp photo.
+ * @param path Path of a file that may not exist.
+ * @return Returns 1 when they are the same file, 0 when they differ or the path does not exist.
+ */
+int same_file(bmp_file bmp, const char *path);
 /**
  * @brief Displays the BMP and DIB headers of a BMP file.
  * @details Takes a bmp photo and prints out the contents of the photo's header.
@@ -80,21 +134,24 @@ void display_header(bmp_file bmp);
  * @brief Reveals an photo hidden in the LSbs of an photo.
  * @details Alters the original photo by swapping its MSbs and LSbs and revealing the hidden photo.
  * @param bmp bmp photo containing a hidden photo.
+ * @return Returns 1 when revealed, 0 when the photo is not 24 bpp or memory runs out.
  */
-void reveal(bmp_file bmp);
+int reveal(bmp_file bmp);
 /**
  * @brief Reveals a hidden photo hidden while still showing the original.
- * @details Alters the original photo by swapping some of its MSbs and LSbs and partially revealing the hidden photo.
+ * @details Swaps the MSbs and LSbs of each color exactly as reveal() does.
  * @param bmp bmp photo containing a hidden photo.
+ * @return Returns 1 when revealed, 0 as reveal() does otherwise.
  */
-void peek(bmp_file bmp);
+int peek(bmp_file bmp);
 /**
  * @brief Hides one photo inside of another photo.
  * @details Stores the MSbs of the hidden photo as the LSbs of the target photo.
  * @param target Target bmp photo which will hide the other photo.
  * @param hidden bmp photo to hide inside of the target photo
+ * @return Returns 1 when hidden, 0 when the photos are not 24 bpp, differ in size, or memory runs out.
  */
-void hide(bmp_file target, bmp_file hidden);
+int hide(bmp_file target, bmp_file hidden);
 /**
  * @brief Invert the pixels of an image.
  * @details Flips the bits of each pixel to create a hue opposite of the original color.
@@ -141,7 +198,7 @@ void copy(rgb *color1, rgb *color2);
  * @param color A single color.
  * @return Returns a color with swapped bits.
  */
-char swap_bits(char color);
+uint8_t swap_bits(uint8_t color);
 /**
  * @brief Creates a color storing the most significant bits of both colors in the order of the parameters.
  * @details Stores in a new color the most significant bits of two colors.
@@ -151,14 +208,14 @@ char swap_bits(char color);
  * @param color2 This MSbs of this color are the LSbs of the new color.
  * @return Returns a color with the MSbs of two colors, the MSbs of the new color reflect color1.
  */
-char combine_bits(char color1, char color2);
+uint8_t combine_bits(uint8_t color1, uint8_t color2);
 /**
  * @brief Inverts a color by flipping to opposite hue on the color wheel.
  * @details Flips the bits of the given color.
  * @param color A single color.
  * @return Returns an inverted color with the complementing bit pattern.
  */
-char invert_bits(char color);
+uint8_t invert_bits(uint8_t color);
 
 /*****************************/
 /* Compression and Expansion */
@@ -169,14 +226,14 @@ char invert_bits(char color);
  * @param color A single color.
  * @return Returns the linearized sRGB value.
  */
-double linearize(unsigned char color);
+double linearize(uint8_t color);
 /**
  * @brief Delinearize a color.
  * @details Delinearize using gamma compression the luminance, a weighted sum of the linearized RGB colors.
  * @param color A single color, linearized and in sRGB colorspace.
  * @return Returns the delinearized monochromat value.
  */
-unsigned char delinearize(double color_lin);
+uint8_t delinearize(double color_lin);
 
 /*****************/
 /***** Files *****/
@@ -204,6 +261,51 @@ void checked_read(void *restrict __ptr, size_t __size, size_t __nitems, FILE *re
  * @param __stream File stream from which data is being written.
  */
 void checked_write(void *restrict __ptr, size_t __size, size_t __nitems, FILE *restrict __stream);
+/**
+ * @brief Number of bytes in a row of pixels, including the padding.
+ * @details Rows are padded to a multiple of 4 bytes.
+ * @param header The header of a bmp photo.
+ * @return Returns the size of a padded row in bytes.
+ */
+int row_stride(bmp_header header);
+/**
+ * @brief Decodes a header from its stored bytes.
+ * @param bytes The first HEADER_SIZE bytes of a bmp file.
+ * @param header Set to the decoded header.
+ */
+void decode_header(const uint8_t bytes[HEADER_SIZE], bmp_header *header);
+/**
+ * @brief Encodes a header as it is stored.
+ * @param header The header of a bmp photo.
+ * @param bytes Set to the HEADER_SIZE bytes that start the file.
+ */
+void encode_header(bmp_header header, uint8_t bytes[HEADER_SIZE]);
+/**
+ * @brief Reads and decodes a header with a single positioned read.
+ * @details Leaves the position of the file unchanged.
+ * @param file Descriptor of an open bmp file.
+ * @param header Set to the decoded header.
+ * @return Returns 1 when read, 0 when the file is shorter than a header or cannot be read.
+ */
+int read_header(int file, bmp_header *header);
+/**
+ * @brief Reads consecutive rows of pixels, including the padding, into a buffer.
+ * @details Rows are numbered as stored, from the bottom of the photo to the top.
+ *          Reads by position, so several threads may read and write rows of the same photo at once.
+ * @param bmp A bmp photo.
+ * @param row The first row to read.
+ * @param count Number of rows to read.
+ * @param buffer Holds at least `count * row_stride(bmp.header)` bytes.
+ */
+void read_rows(bmp_file bmp, int row, int count, uint8_t *buffer);
+/**
+ * @brief Writes consecutive rows of pixels, including the padding, from a buffer.
+ * @param bmp A bmp photo.
+ * @param row The first row to write.
+ * @param count Number of rows to write.
+ * @param buffer Holds at least `count * row_stride(bmp.header)` bytes.
+ */
+void write_rows(bmp_file bmp, int row, int count, uint8_t *buffer);
 
 /****************************************/
 /************** Validation **************/
@@ -212,4 +314,21 @@ void checked_write(void *restrict __ptr, size_t __size, size_t __nitems, FILE *r
  * @brief Validate that the bits per pixel is 24.
  * @param bmp The bits per pixel of a bmp image.
  */
-int validate_bpp(int bpp);
\ No newline at end of file
+int validate_bpp(int bpp);
+/**
+ * @brief Checks that a header describes an uncompressed 24 bpp photo held within the file.
+ * @details Checks the magic, DIB header size, dimensions, bpp, compression,
+ *          pixel offset, and that every row of pixels fits in the file.
+ * @param header The header of a bmp file.
+ * @param length Number of bytes in the file.
+ * @return Returns HEADER_VALID, or the first problem found.
+ */
+enum header_problem check_header(bmp_header header, long long length);
+/**
+ * @brief Short name of a header problem, such as "truncated".
+ * @param problem A header problem.
+ * @return Returns the name of the problem.
+ */
+const char *header_problem_name(enum header_problem problem);
+
+#endif
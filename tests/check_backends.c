@@ -0,0 +1,1509 @@
+/**
+ * @file check_backends.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Checks every operation against per pixel reference code on random photos.
+ *
+ * Photos of random sizes, odd widths, single pixels, rows, and columns, and one large photo
+ * are generated from a seed. Each operation runs over a copy of the photo and is compared byte for
+ * byte, padding included, with the same operation written here a pixel at a time. Every size runs
+ * on one thread and split into bands across several, covering the streaming row loops, the halos
+ * between bands, and the whole photo paths. Built twice by the makefile, once with the SIMD paths
+ * and once with them compiled out. Malformed headers are checked against open_bmp and check_header.
+ * Linked with acquire_buffer wrapped, so the buffers of an operation can be made to run out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "stenography.h"
+#include "statistics.h"
+#include "filter.h"
+#include "composite.h"
+#include "planar.h"
+#include "pipeline.h"
+#include "pyramid.h"
+#include "color.h"
+
+#define DEFAULT_SEED 20240601u
+#define RANDOM_SIZES 6        // random sizes added to the fixed sizes
+#define RANDOM_HEADERS 2000   // headers with random bytes altered
+#define MAX_PYRAMID_LEVELS 4  // levels of the pyramid checked
+#ifdef __SSE2__
+#define SIMD_NAME "SIMD"
+#else
+#define SIMD_NAME "scalar"
+#endif
+
+/**
+ * Rows of pixels in memory, stored as in a bmp from the bottom row up with zeroed padding
+ */
+typedef struct
+{
+    int width, height, stride;
+    unsigned char *pixels;
+} photo_pixels;
+/**
+ * The photos of one size and the files holding them
+ */
+typedef struct
+{
+    photo_pixels input, other, mark;
+    char input_path[4096], other_path[4096], mark_path[4096];
+    char output_path[4096], work[4096];
+} backend_photos;
+/**
+ * An operation and its reference, both given the same setting
+ */
+typedef struct
+{
+    const char *name;
+    const char *setting;
+    void (*apply)(bmp_file bmp, const backend_photos *photos, const char *setting);
+    void (*reference)(photo_pixels *out, const backend_photos *photos, const char *setting);
+} backend_check;
+
+static int failing_buffers; // acquire_buffer returns NULL while set
+
+static const int fixed_sizes[][2] = {
+    {1, 1}, {1, 2}, {2, 1}, {3, 3}, {5, 17}, {1, 40}, {40, 1}, {7, 33}, {17, 48}, {64, 5}, {67, 129}, {1283, 701},
+};
+
+/****************************************/
+/*************** Buffers ****************/
+/****************************************/
+void *__real_acquire_buffer(size_t size);
+
+void *__wrap_acquire_buffer(size_t size)
+{
+    return failing_buffers ? NULL : __real_acquire_buffer(size);
+}
+
+/****************************************/
+/**************** Photos ****************/
+/****************************************/
+static unsigned next_random(unsigned *state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 16 & 0x7FFF;
+}
+
+static photo_pixels new_photo(int width, int height)
+{
+    photo_pixels photo = {width, height, (3 * width + 3) & ~3, NULL};
+    photo.pixels = calloc((size_t)photo.stride * height, 1);
+    return photo;
+}
+
+static photo_pixels copy_photo(const photo_pixels *photo)
+{
+    photo_pixels copy = new_photo(photo->width, photo->height);
+    memcpy(copy.pixels, photo->pixels, (size_t)photo->stride * photo->height);
+    return copy;
+}
+
+static photo_pixels random_photo(int width, int height, unsigned *state)
+{
+    photo_pixels photo = new_photo(width, height);
+    for (int h = 0; h < height; h++)
+    {
+        for (int i = 0; i < 3 * width; i++)
+        {
+            photo.pixels[(size_t)h * photo.stride + i] = next_random(state) & 0xFF;
+        }
+    }
+
+    // Both ends of each channel
+    memset(photo.pixels, 255, 3);
+    if (width > 1)
+    {
+        memset(photo.pixels + 3, 0, 3);
+    }
+    return photo;
+}
+
+static unsigned char *color_at(const photo_pixels *photo, int x, int y)
+{
+    x = x < 0 ? 0 : x >= photo->width ? photo->width - 1 : x;
+    y = y < 0 ? 0 : y >= photo->height ? photo->height - 1 : y;
+    return photo->pixels + (size_t)y * photo->stride + x * sizeof(rgb);
+}
+
+static bmp_header photo_header(int width, int height)
+{
+    int stride = (3 * width + 3) & ~3;
+    bmp_header header = {{{'B', 'M'}, HEADER_SIZE + stride * height, 0, 0, HEADER_SIZE},
+                         {40, width, height, 1, 24, 0, stride * height, 2835, 2835, 0, 0}};
+    return header;
+}
+
+/**
+ * @brief Writes a photo as a 24 bpp bmp.
+ * @return Returns 1 when written, 0 otherwise.
+ */
+static int write_photo(const char *path, const photo_pixels *photo)
+{
+    uint8_t bytes[HEADER_SIZE];
+    encode_header(photo_header(photo->width, photo->height), bytes);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    int written = fwrite(bytes, 1, HEADER_SIZE, file) == HEADER_SIZE &&
+                  fwrite(photo->pixels, photo->stride, photo->height, file) == (size_t)photo->height;
+    return fclose(file) == 0 && written;
+}
+
+/**
+ * @brief Reads a whole file.
+ * @return Returns the bytes, freed by the caller, or NULL when the file cannot be read.
+ */
+static unsigned char *read_file(const char *path, long *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char *bytes = malloc(*size > 0 ? *size : 1);
+    if (bytes != NULL && fread(bytes, 1, *size, file) != (size_t)*size)
+    {
+        free(bytes);
+        bytes = NULL;
+    }
+    fclose(file);
+    return bytes;
+}
+
+/**
+ * @brief Compares a written photo with its expected size and pixels, describing the first difference.
+ * @return Returns 1 when they match, 0 otherwise.
+ */
+static int matches_photo(const char *path, const photo_pixels *expected, const char *label)
+{
+    long length;
+    unsigned char *bytes = read_file(path, &length);
+    long expected_length = HEADER_SIZE + (long)expected->stride * expected->height;
+    if (bytes == NULL || length != expected_length)
+    {
+        fprintf(stderr, "FAIL %s: %ld bytes, expected %ld.\n", label, bytes == NULL ? -1 : length, expected_length);
+        free(bytes);
+        return 0;
+    }
+
+    bmp_header header;
+    decode_header(bytes, &header);
+    int same = header.dib.width == expected->width && header.dib.height == expected->height;
+    if (!same)
+    {
+        fprintf(stderr, "FAIL %s: %ix%i, expected %ix%i.\n", label, header.dib.width, header.dib.height, expected->width, expected->height);
+    }
+    for (long i = 0; same && i < length - HEADER_SIZE; i++)
+    {
+        if (bytes[HEADER_SIZE + i] != expected->pixels[i])
+        {
+            long row = i / expected->stride, column = i % expected->stride;
+            fprintf(stderr, "FAIL %s: row %ld byte %ld is %i, expected %i.\n", label, row, column, bytes[HEADER_SIZE + i], expected->pixels[i]);
+            same = 0;
+        }
+    }
+    free(bytes);
+    return same;
+}
+
+/**
+ * @brief Sends standard output and error to /dev/null, keeping the originals in saved.
+ */
+static void silence(int saved[2])
+{
+    fflush(stdout);
+    fflush(stderr);
+    int null = open("/dev/null", O_WRONLY);
+    saved[0] = dup(STDOUT_FILENO);
+    saved[1] = dup(STDERR_FILENO);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    close(null);
+}
+
+/**
+ * @brief Restores standard output and error after silence().
+ */
+static void restore(int saved[2])
+{
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved[0], STDOUT_FILENO);
+    dup2(saved[1], STDERR_FILENO);
+    close(saved[0]);
+    close(saved[1]);
+}
+
+/****************************************/
+/******* Stenography and Pipeline *******/
+/****************************************/
+static void apply_reveal(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    reveal(bmp);
+}
+
+static void apply_peek(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    peek(bmp);
+}
+
+static void apply_hide(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    bmp_file hidden = open_bmp(photos->other_path);
+    if (hidden.photo != NULL)
+    {
+        hide(bmp, hidden);
+        close_bmp(hidden);
+    }
+}
+
+static void apply_invert(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    invert(bmp);
+}
+
+static void apply_grayscale(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    grayscale(bmp);
+}
+
+static void apply_hflip(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    hflip_image(bmp);
+}
+
+static void apply_mirror(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    mirror(bmp);
+}
+
+/**
+ * @brief Runs a chain over the photo in place.
+ */
+static void apply_pipeline(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    pipeline_stage stages[MAX_STAGES];
+    int count = parse_pipeline(setting, stages);
+    if (count >= 0)
+    {
+        run_pipeline(bmp, stages, count);
+    }
+}
+
+/**
+ * @brief Runs a chain from the input into the photo, cleared first so every row must be written.
+ */
+static void apply_pipeline_into(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    pipeline_stage stages[MAX_STAGES];
+    int count = parse_pipeline(setting, stages);
+    bmp_file source = open_bmp(photos->input_path);
+    size_t size = (size_t)row_stride(bmp.header) * bmp.header.dib.height;
+    unsigned char *zero = calloc(size, 1);
+    if (count >= 0 && source.photo != NULL && zero != NULL)
+    {
+        write_rows(bmp, 0, bmp.header.dib.height, zero);
+        run_pipeline_into(source, bmp, stages, count);
+    }
+    if (source.photo != NULL)
+    {
+        close_bmp(source);
+    }
+    free(zero);
+}
+
+static void map_colors(photo_pixels *out, uint8_t (*function)(uint8_t color))
+{
+    for (int h = 0; h < out->height; h++)
+    {
+        for (int i = 0; i < 3 * out->width; i++)
+        {
+            unsigned char *color = out->pixels + (size_t)h * out->stride + i;
+            *color = function(*color);
+        }
+    }
+}
+
+static uint8_t reveal_color(uint8_t color)
+{
+    return (color << 4 | color >> 4) & 0xFF;
+}
+
+static uint8_t invert_color(uint8_t color)
+{
+    return ~color & 0xFF;
+}
+
+static void reference_reveal(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    map_colors(out, reveal_color);
+}
+
+static void reference_invert(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    map_colors(out, invert_color);
+}
+
+static void reference_hide(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    for (int h = 0; h < out->height; h++)
+    {
+        for (int w = 0; w < out->width; w++)
+        {
+            unsigned char *color = color_at(out, w, h), *hidden = color_at(&photos->other, w, h);
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                color[c] = (color[c] & 0xF0) | hidden[c] >> 4;
+            }
+        }
+    }
+}
+
+static void reference_grayscale(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    for (int h = 0; h < out->height; h++)
+    {
+        for (int w = 0; w < out->width; w++)
+        {
+            unsigned char *color = color_at(out, w, h);
+            double luminance = 0.2126 * linearize(color[CHANNEL_RED]) + 0.7152 * linearize(color[CHANNEL_GREEN]) +
+                               0.0722 * linearize(color[CHANNEL_BLUE]);
+            memset(color, delinearize(luminance), CHANNELS);
+        }
+    }
+}
+
+static void reference_hflip(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    for (int h = 0; h < out->height; h++)
+    {
+        for (int w = 0; w < out->width; w++)
+        {
+            memcpy(color_at(out, w, h), color_at(&photos->input, out->width - 1 - w, h), sizeof(rgb));
+        }
+    }
+}
+
+static void reference_mirror(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    for (int h = 0; h < out->height; h++)
+    {
+        for (int w = out->width - out->width / 2; w < out->width; w++)
+        {
+            memcpy(color_at(out, w, h), color_at(&photos->input, out->width - 1 - w, h), sizeof(rgb));
+        }
+    }
+}
+
+/**
+ * @brief Transforms the colors of every pixel as written in color.h.
+ */
+static void reference_matrix(photo_pixels *out, const color_matrix *matrix)
+{
+    for (int h = 0; h < out->height; h++)
+    {
+        for (int w = 0; w < out->width; w++)
+        {
+            unsigned char *color = color_at(out, w, h);
+            int result[CHANNELS];
+            for (int k = 0; k < CHANNELS; k++)
+            {
+                int sum = 1 << (matrix->bits - 1);
+                for (int c = 0; c < CHANNELS; c++)
+                {
+                    sum += matrix->m[k][c] * (color[c] - matrix->in_offset[c]);
+                }
+                int value = (sum >> matrix->bits) + matrix->out_offset[k];
+                result[k] = value < 0 ? 0 : value > 255 ? 255 : value;
+            }
+            for (int k = 0; k < CHANNELS; k++)
+            {
+                color[k] = result[k];
+            }
+        }
+    }
+}
+
+/**
+ * @brief The matrix of a kernel that transforms colors.
+ */
+static color_matrix kernel_matrix(const char *name, double amount)
+{
+    if (strcmp(name, "hue") == 0)
+    {
+        return hue_matrix(amount);
+    }
+    if (strcmp(name, "saturation") == 0)
+    {
+        return saturation_matrix(amount);
+    }
+    if (strcmp(name, "brightness") == 0)
+    {
+        return brightness_matrix(amount);
+    }
+    return strcmp(name, "ycbcr") == 0 ? ycbcr_matrix() : rgb_matrix();
+}
+
+static void reference_pipeline(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    pipeline_stage stages[MAX_STAGES];
+    int count = parse_pipeline(setting, stages);
+    for (int s = 0; s < count; s++)
+    {
+        const char *name = stages[s].kernel->name;
+        if (strcmp(name, "invert") == 0)
+        {
+            map_colors(out, invert_color);
+        }
+        else if (strcmp(name, "reveal") == 0)
+        {
+            map_colors(out, reveal_color);
+        }
+        else if (strcmp(name, "grayscale") == 0)
+        {
+            reference_grayscale(out, photos, NULL);
+        }
+        else
+        {
+            color_matrix matrix = kernel_matrix(name, stages[s].amount);
+            reference_matrix(out, &matrix);
+        }
+    }
+}
+
+/****************************************/
+/*************** Adjusting **************/
+/****************************************/
+static void apply_adjust(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    double degrees, saturation, brightness;
+    sscanf(setting, "%lf %lf %lf", &degrees, &saturation, &brightness);
+    adjust_colors(bmp, degrees, saturation, brightness);
+}
+
+static void multiply(const double second[3][3], const double first[3][3], double result[3][3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            result[i][j] = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                result[i][j] += second[i][k] * first[k][j];
+            }
+        }
+    }
+}
+
+/**
+ * @brief The hue rotation, then saturation, then brightness of adjust_colors() as one fixed point matrix.
+ */
+static void reference_adjust(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    double degrees, f, b;
+    sscanf(setting, "%lf %lf %lf", &degrees, &f, &b);
+    double c = cos(degrees * M_PI / 180), s = sin(degrees * M_PI / 180);
+    const double hue[3][3] = {
+        {0.213 + c * 0.787 - s * 0.213, 0.715 - c * 0.715 - s * 0.715, 0.072 - c * 0.072 + s * 0.928},
+        {0.213 - c * 0.213 + s * 0.143, 0.715 + c * 0.285 + s * 0.140, 0.072 - c * 0.072 - s * 0.283},
+        {0.213 - c * 0.213 - s * 0.787, 0.715 - c * 0.715 + s * 0.715, 0.072 + c * 0.928 + s * 0.072},
+    };
+    const double saturate[3][3] = {
+        {0.213 + 0.787 * f, 0.715 - 0.715 * f, 0.072 - 0.072 * f},
+        {0.213 - 0.213 * f, 0.715 + 0.285 * f, 0.072 - 0.072 * f},
+        {0.213 - 0.213 * f, 0.715 - 0.715 * f, 0.072 + 0.928 * f},
+    };
+    const double brighten[3][3] = {{b, 0, 0}, {0, b, 0}, {0, 0, b}};
+    double combined[3][3], transform[3][3];
+    multiply(saturate, hue, combined);
+    multiply(brighten, combined, transform);
+
+    // Rows and columns in red, green, blue order
+    const int channels[3] = {CHANNEL_RED, CHANNEL_GREEN, CHANNEL_BLUE};
+    color_matrix matrix = {.bits = ADJUST_BITS};
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            double coefficient = round(transform[i][j] * (1 << ADJUST_BITS));
+            matrix.m[channels[i]][channels[j]] = coefficient > INT16_MAX ? INT16_MAX : coefficient < INT16_MIN ? INT16_MIN : coefficient;
+        }
+    }
+    reference_matrix(out, &matrix);
+}
+
+/**
+ * @brief Loads the whole photo into planes, rotates the hue of each row, and saves it.
+ */
+static void apply_planar(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    planar_image image;
+    if (!load_planar(bmp, &image))
+    {
+        return;
+    }
+    color_matrix matrix = hue_matrix(atof(setting));
+    for (int h = 0; h < image.height; h++)
+    {
+        unsigned char *planes[CHANNELS];
+        for (int p = 0; p < CHANNELS; p++)
+        {
+            planes[p] = image.planes[p] + (size_t)h * image.stride;
+        }
+        transform_row(&matrix, planes, image.width);
+    }
+    save_planar(bmp, &image);
+    free_planar(&image);
+}
+
+static void reference_planar(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    color_matrix matrix = hue_matrix(atof(setting));
+    reference_matrix(out, &matrix);
+}
+
+/****************************************/
+/************** Statistics **************/
+/****************************************/
+/**
+ * @brief A table mapping each color to another, the same for every seed.
+ */
+static void scrambled_lut(unsigned char lut[CHANNELS][256])
+{
+    unsigned state = 7;
+    for (int c = 0; c < CHANNELS; c++)
+    {
+        for (int v = 0; v < 256; v++)
+        {
+            lut[c][v] = next_random(&state) & 0xFF;
+        }
+    }
+}
+
+static void apply_lut_check(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    unsigned char lut[CHANNELS][256];
+    scrambled_lut(lut);
+    apply_lut(bmp, lut);
+}
+
+static void apply_auto_contrast(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    auto_contrast(bmp);
+}
+
+static void apply_equalize(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    equalize(bmp);
+}
+
+static void map_lut(photo_pixels *out, unsigned char lut[CHANNELS][256])
+{
+    for (int h = 0; h < out->height; h++)
+    {
+        for (int w = 0; w < out->width; w++)
+        {
+            unsigned char *color = color_at(out, w, h);
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                color[c] = lut[c][color[c]];
+            }
+        }
+    }
+}
+
+static void histogram(const photo_pixels *photo, unsigned long counts[CHANNELS][256])
+{
+    memset(counts, 0, sizeof(unsigned long) * CHANNELS * 256);
+    for (int h = 0; h < photo->height; h++)
+    {
+        for (int w = 0; w < photo->width; w++)
+        {
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                counts[c][color_at(photo, w, h)[c]]++;
+            }
+        }
+    }
+}
+
+static void reference_lut(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    unsigned char lut[CHANNELS][256];
+    scrambled_lut(lut);
+    map_lut(out, lut);
+}
+
+static void reference_auto_contrast(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    unsigned long counts[CHANNELS][256];
+    unsigned char lut[CHANNELS][256];
+    histogram(out, counts);
+    for (int c = 0; c < CHANNELS; c++)
+    {
+        int low = 0, high = 255;
+        while (counts[c][low] == 0)
+        {
+            low++;
+        }
+        while (counts[c][high] == 0)
+        {
+            high--;
+        }
+        for (int v = 0; v < 256; v++)
+        {
+            lut[c][v] = low == high ? v : v <= low ? 0 : v >= high ? 255 : ((v - low) * 255 + (high - low) / 2) / (high - low);
+        }
+    }
+    map_lut(out, lut);
+}
+
+static void reference_equalize(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    unsigned long counts[CHANNELS][256];
+    unsigned char lut[CHANNELS][256];
+    histogram(out, counts);
+    unsigned long pixels = (unsigned long)out->width * out->height;
+    for (int c = 0; c < CHANNELS; c++)
+    {
+        int low = 0;
+        while (counts[c][low] == 0)
+        {
+            low++;
+        }
+        unsigned long darkest = counts[c][low], range = pixels - darkest, cumulative = 0;
+        for (int v = 0; v < 256; v++)
+        {
+            cumulative += counts[c][v];
+            lut[c][v] = range == 0 ? v : cumulative <= darkest ? 0 : ((cumulative - darkest) * 255 + range / 2) / range;
+        }
+    }
+    map_lut(out, lut);
+}
+
+/****************************************/
+/*************** Filters ****************/
+/****************************************/
+static void apply_box_blur(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    box_blur(bmp, atoi(setting));
+}
+
+static void apply_blur(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    blur(bmp, atoi(setting));
+}
+
+static void apply_gaussian(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    gaussian_blur(bmp, atof(setting));
+}
+
+static void apply_sharpen(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    sharpen(bmp, atof(setting));
+}
+
+static void apply_edges(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    edge_detect(bmp);
+}
+
+static int clamp_color(int value)
+{
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+/**
+ * @brief Averages the square within radius of each pixel, repeating the edge pixels.
+ */
+static void box_pass(photo_pixels *out, int radius)
+{
+    photo_pixels in = copy_photo(out);
+    int area = (2 * radius + 1) * (2 * radius + 1);
+    unsigned long long reciprocal = ((1ULL << 24) + area / 2) / area;
+    for (int h = 0; h < out->height; h++)
+    {
+        for (int w = 0; w < out->width; w++)
+        {
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                int sum = 0;
+                for (int dy = -radius; dy <= radius; dy++)
+                {
+                    for (int dx = -radius; dx <= radius; dx++)
+                    {
+                        sum += color_at(&in, w + dx, h + dy)[c];
+                    }
+                }
+                color_at(out, w, h)[c] = (sum * reciprocal + (1ULL << 23)) >> 24;
+            }
+        }
+    }
+    free(in.pixels);
+}
+
+static void reference_box_blur(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    box_pass(out, atoi(setting));
+}
+
+static void reference_blur(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        box_pass(out, atoi(setting));
+    }
+}
+
+/**
+ * @brief Sums of a kernel across each row, saturated to shorts, then down each column, repeating the edges.
+ * @return Returns the sums, indexed by row, then column, then channel.
+ */
+static int *separable_sums(const photo_pixels *in, int radius, const int *horizontal, const int *vertical)
+{
+    size_t n = (size_t)in->width * in->height * CHANNELS;
+    int *across = malloc(sizeof(int) * n), *sums = malloc(sizeof(int) * n);
+    for (int h = 0; h < in->height; h++)
+    {
+        for (int w = 0; w < in->width; w++)
+        {
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                int sum = 0;
+                for (int k = 0; k <= 2 * radius; k++)
+                {
+                    sum += horizontal[k] * color_at(in, w + k - radius, h)[c];
+                }
+                across[((size_t)h * in->width + w) * CHANNELS + c] = sum < -32768 ? -32768 : sum > 32767 ? 32767 : sum;
+            }
+        }
+    }
+    for (int h = 0; h < in->height; h++)
+    {
+        for (int i = 0; i < in->width * CHANNELS; i++)
+        {
+            int sum = 0;
+            for (int k = 0; k <= 2 * radius; k++)
+            {
+                int row = h + k - radius < 0 ? 0 : h + k - radius >= in->height ? in->height - 1 : h + k - radius;
+                sum += vertical[k] * across[(size_t)row * in->width * CHANNELS + i];
+            }
+            sums[(size_t)h * in->width * CHANNELS + i] = sum;
+        }
+    }
+    free(across);
+    return sums;
+}
+
+static void reference_gaussian(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    double sigma = atof(setting);
+    int radius = (int)ceil(3 * sigma);
+    radius = radius < 1 ? 1 : radius > MAX_RADIUS ? MAX_RADIUS : radius;
+
+    // Weights summing to 128, the center takes the rounding error
+    double values[2 * MAX_RADIUS + 1], total = 0;
+    int weights[2 * MAX_RADIUS + 1], sum = 0;
+    for (int k = -radius; k <= radius; k++)
+    {
+        values[k + radius] = exp(-(k * k) / (2 * sigma * sigma));
+        total += values[k + radius];
+    }
+    for (int k = 0; k < 2 * radius + 1; k++)
+    {
+        weights[k] = (int16_t)lround(values[k] / total * 128);
+        sum += weights[k];
+    }
+    weights[radius] += 128 - sum;
+
+    int *sums = separable_sums(out, radius, weights, weights);
+    for (int h = 0; h < out->height; h++)
+    {
+        for (int i = 0; i < out->width * CHANNELS; i++)
+        {
+            out->pixels[(size_t)h * out->stride + i] = clamp_color((sums[(size_t)h * out->width * CHANNELS + i] + (1 << 13)) >> 14);
+        }
+    }
+    free(sums);
+}
+
+static void reference_sharpen(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    const int weights[3] = {32, 64, 32};
+    int amount = (int)lround(atof(setting) * 256);
+    int *sums = separable_sums(out, 1, weights, weights);
+    for (int h = 0; h < out->height; h++)
+    {
+        for (int i = 0; i < out->width * CHANNELS; i++)
+        {
+            unsigned char *color = out->pixels + (size_t)h * out->stride + i;
+            int blurred = (sums[(size_t)h * out->width * CHANNELS + i] + (1 << 13)) >> 14;
+            *color = clamp_color(*color + (((*color - blurred) * amount + 128) >> 8));
+        }
+    }
+    free(sums);
+}
+
+static void reference_edges(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    const int gradient[3] = {-1, 0, 1}, smoothing[3] = {1, 2, 1};
+    int *across = separable_sums(out, 1, gradient, smoothing);
+    int *down = separable_sums(out, 1, smoothing, gradient);
+    for (int h = 0; h < out->height; h++)
+    {
+        for (int i = 0; i < out->width * CHANNELS; i++)
+        {
+            size_t s = (size_t)h * out->width * CHANNELS + i;
+            out->pixels[(size_t)h * out->stride + i] = clamp_color((abs(across[s]) + abs(down[s])) >> 2);
+        }
+    }
+    free(across);
+    free(down);
+}
+
+/****************************************/
+/************** Composites **************/
+/****************************************/
+static enum blend_mode blend_named(const char *name)
+{
+    return strncmp(name, "add", 3) == 0        ? BLEND_ADD
+           : strncmp(name, "multiply", 8) == 0 ? BLEND_MULTIPLY
+           : strncmp(name, "difference", 10) == 0 ? BLEND_DIFFERENCE
+                                                 : BLEND_ALPHA;
+}
+
+static void apply_composite(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    bmp_file source = open_bmp(photos->other_path);
+    if (source.photo != NULL)
+    {
+        composite(bmp, source, blend_named(setting), atof(strchr(setting, ' ') + 1));
+        close_bmp(source);
+    }
+}
+
+static void apply_watermark(bmp_file bmp, const backend_photos *photos, const char *setting)
+{
+    int x, y;
+    double opacity;
+    sscanf(setting, "%i %i %lf", &x, &y, &opacity);
+    bmp_file mark = open_bmp(photos->mark_path);
+    if (mark.photo != NULL)
+    {
+        watermark(bmp, mark, x, y, opacity);
+        close_bmp(mark);
+    }
+}
+
+/**
+ * @brief Blends a color, mixing by the opacity rounded to 1/256.
+ */
+static int blend(int target, int source, enum blend_mode mode, double opacity)
+{
+    int blended = mode == BLEND_ADD            ? (target + source > 255 ? 255 : target + source)
+                  : mode == BLEND_MULTIPLY     ? (int)lround(target * source / 255.0)
+                  : mode == BLEND_DIFFERENCE   ? abs(target - source)
+                                               : source;
+    int weight = (int)lround((opacity < 0 ? 0 : opacity > 1 ? 1 : opacity) * 256);
+    return (target * (256 - weight) + blended * weight + 128) >> 8;
+}
+
+static void reference_composite(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    enum blend_mode mode = blend_named(setting);
+    double opacity = atof(strchr(setting, ' ') + 1);
+    for (int h = 0; h < out->height; h++)
+    {
+        for (int w = 0; w < out->width; w++)
+        {
+            unsigned char *color = color_at(out, w, h), *source = color_at(&photos->other, w, h);
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                color[c] = blend(color[c], source[c], mode, opacity);
+            }
+        }
+    }
+}
+
+static void reference_watermark(photo_pixels *out, const backend_photos *photos, const char *setting)
+{
+    int x, y;
+    double opacity;
+    sscanf(setting, "%i %i %lf", &x, &y, &opacity);
+    const photo_pixels *mark = &photos->mark;
+    for (int h = 0; h < out->height; h++)
+    {
+        for (int w = 0; w < out->width; w++)
+        {
+            // x and y are measured from the top left, rows are stored from the bottom up
+            int mark_x = w - x, mark_y = mark->height - 1 - (out->height - 1 - h - y);
+            if (mark_x < 0 || mark_x >= mark->width || mark_y < 0 || mark_y >= mark->height)
+            {
+                continue;
+            }
+            unsigned char *color = color_at(out, w, h), *source = color_at(mark, mark_x, mark_y);
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                color[c] = blend(color[c], source[c], BLEND_ALPHA, opacity);
+            }
+        }
+    }
+}
+
+static const backend_check checks[] = {
+    {"reveal", "", apply_reveal, reference_reveal},
+    {"peek", "", apply_peek, reference_reveal},
+    {"hide", "", apply_hide, reference_hide},
+    {"invert", "", apply_invert, reference_invert},
+    {"grayscale", "", apply_grayscale, reference_grayscale},
+    {"hflip", "", apply_hflip, reference_hflip},
+    {"mirror", "", apply_mirror, reference_mirror},
+    {"pipeline", "invert", apply_pipeline, reference_pipeline},
+    {"pipeline", "reveal", apply_pipeline, reference_pipeline},
+    {"pipeline", "grayscale", apply_pipeline, reference_pipeline},
+    {"pipeline", "hue:75", apply_pipeline, reference_pipeline},
+    {"pipeline", "saturation:1.7", apply_pipeline, reference_pipeline},
+    {"pipeline", "brightness:0.6", apply_pipeline, reference_pipeline},
+    {"pipeline", "ycbcr", apply_pipeline, reference_pipeline},
+    {"pipeline", "rgb", apply_pipeline, reference_pipeline},
+    {"pipeline", "grayscale,invert,hue:200,reveal,saturation:3", apply_pipeline, reference_pipeline},
+    {"pipeline into", "ycbcr,rgb", apply_pipeline_into, reference_pipeline},
+    {"pipeline into", "brightness:4,invert,grayscale", apply_pipeline_into, reference_pipeline},
+    {"adjust", "30 1.5 0.8", apply_adjust, reference_adjust},
+    {"adjust", "-120 0 2", apply_adjust, reference_adjust},
+    {"planar", "45", apply_planar, reference_planar},
+    {"lut", "", apply_lut_check, reference_lut},
+    {"auto contrast", "", apply_auto_contrast, reference_auto_contrast},
+    {"equalize", "", apply_equalize, reference_equalize},
+    {"box blur", "1", apply_box_blur, reference_box_blur},
+    {"box blur", "3", apply_box_blur, reference_box_blur},
+    {"blur", "2", apply_blur, reference_blur},
+    {"gaussian", "0.6", apply_gaussian, reference_gaussian},
+    {"gaussian", "4", apply_gaussian, reference_gaussian},
+    {"sharpen", "1.5", apply_sharpen, reference_sharpen},
+    {"sharpen", "0.3", apply_sharpen, reference_sharpen},
+    {"edges", "", apply_edges, reference_edges},
+    {"composite", "alpha 0.35", apply_composite, reference_composite},
+    {"composite", "add 1", apply_composite, reference_composite},
+    {"composite", "multiply 0.8", apply_composite, reference_composite},
+    {"composite", "difference 0.5", apply_composite, reference_composite},
+    {"watermark", "0 0 0.5", apply_watermark, reference_watermark},
+    {"watermark", "-2 -1 0.7", apply_watermark, reference_watermark},
+    {"watermark", "3 2 1", apply_watermark, reference_watermark},
+};
+
+/****************************************/
+/**************** Checks ****************/
+/****************************************/
+/**
+ * @brief Counts a check that passed.
+ * @return Returns 1 when the check failed, 0 otherwise.
+ */
+static int tally(int same, int *passed)
+{
+    if (same)
+    {
+        (*passed)++;
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Runs one operation over a copy of the input and compares it with its reference.
+ * @return Returns 1 when the output matches the reference, 0 otherwise.
+ */
+static int run_check(const backend_check *check, const backend_photos *photos, const char *backend)
+{
+    char label[256];
+    snprintf(label, sizeof(label), "%s %s %ix%i %s", check->name, check->setting, photos->input.width, photos->input.height, backend);
+
+    photo_pixels expected = copy_photo(&photos->input);
+    check->reference(&expected, photos, check->setting);
+
+    int same = 0;
+    bmp_file bmp = write_photo(photos->output_path, &photos->input) ? open_bmp(photos->output_path) : (bmp_file){.photo = NULL};
+    if (bmp.photo == NULL)
+    {
+        fprintf(stderr, "FAIL %s: the input could not be written.\n", label);
+    }
+    else
+    {
+        // Operations refusing a photo, such as a watermark off the photo, leave it unchanged
+        int saved[2];
+        silence(saved);
+        check->apply(bmp, photos, check->setting);
+        restore(saved);
+        close_bmp(bmp);
+        same = matches_photo(photos->output_path, &expected, label);
+    }
+    free(expected.pixels);
+    return same;
+}
+
+/**
+ * @brief Compares the statistics and comparison of the photos with counts made a pixel at a time.
+ * @return Returns 1 when they match, 0 otherwise.
+ */
+static int check_statistics(const backend_photos *photos, const char *backend)
+{
+    bmp_file first = open_bmp(photos->input_path), second = open_bmp(photos->other_path);
+    bmp_stats stats;
+    bmp_comparison comparison;
+    int computed = first.photo != NULL && second.photo != NULL && compute_stats(first, &stats) && compare_photos(first, second, &comparison);
+    if (first.photo != NULL)
+    {
+        close_bmp(first);
+    }
+    if (second.photo != NULL)
+    {
+        close_bmp(second);
+    }
+
+    const photo_pixels *in = &photos->input, *other = &photos->other;
+    unsigned long counts[CHANNELS][256], pixels = (unsigned long)in->width * in->height, different = 0;
+    unsigned long long squared_error = 0;
+    int same = computed && stats.pixels == pixels, max_difference = 0;
+    histogram(in, counts);
+    for (int c = 0; c < CHANNELS && same; c++)
+    {
+        double sum = 0;
+        int low = 255, high = 0;
+        for (int v = 0; v < 256; v++)
+        {
+            same &= stats.histogram[c][v] == counts[c][v];
+            if (counts[c][v])
+            {
+                low = v < low ? v : low;
+                high = v;
+                sum += (double)v * counts[c][v];
+            }
+        }
+        same &= stats.min[c] == low && stats.max[c] == high && stats.mean[c] == sum / pixels;
+    }
+    for (int h = 0; h < in->height; h++)
+    {
+        for (int w = 0; w < in->width; w++)
+        {
+            int differs = 0;
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                int difference = abs(color_at(in, w, h)[c] - color_at(other, w, h)[c]);
+                squared_error += difference * difference;
+                max_difference = difference > max_difference ? difference : max_difference;
+                differs |= difference;
+            }
+            different += differs != 0;
+        }
+    }
+    double mean_squared_error = (double)squared_error / (pixels * CHANNELS);
+    double psnr = mean_squared_error == 0 ? INFINITY : 10 * log10(255.0 * 255.0 / mean_squared_error);
+    same &= comparison.pixels == pixels && comparison.different == different &&
+            comparison.max_difference == max_difference && comparison.psnr == psnr;
+
+    if (!same)
+    {
+        fprintf(stderr, "FAIL statistics %ix%i %s: the counts differ from the reference.\n", in->width, in->height, backend);
+    }
+    return same;
+}
+
+/**
+ * @brief Runs out of buffers while loading and saving planes, which must fail and leave the photo unchanged.
+ * @return Returns 1 when both fail cleanly, 0 otherwise.
+ */
+static int check_planar_failure(const backend_photos *photos, const char *backend)
+{
+    char label[256];
+    snprintf(label, sizeof(label), "planar out of memory %ix%i %s", photos->input.width, photos->input.height, backend);
+    bmp_file bmp = write_photo(photos->output_path, &photos->input) ? open_bmp(photos->output_path) : (bmp_file){.photo = NULL};
+    if (bmp.photo == NULL)
+    {
+        fprintf(stderr, "FAIL %s: the input could not be written.\n", label);
+        return 0;
+    }
+
+    int saved[2];
+    planar_image image;
+    silence(saved);
+    failing_buffers = 1;
+    int loaded = load_planar(bmp, &image);
+    failing_buffers = 0;
+    int freed = !loaded && image.planes[CHANNEL_BLUE] == NULL && image.planes[CHANNEL_GREEN] == NULL && image.planes[CHANNEL_RED] == NULL;
+
+    // Planes that differ from the photo, so a partial save would show
+    int saved_planes = 1;
+    if (load_planar(bmp, &image))
+    {
+        for (int p = 0; p < CHANNELS; p++)
+        {
+            memset(image.planes[p], 0x5A, (size_t)image.stride * image.height);
+        }
+        failing_buffers = 1;
+        saved_planes = save_planar(bmp, &image);
+        failing_buffers = 0;
+        free_planar(&image);
+    }
+    restore(saved);
+    close_bmp(bmp);
+
+    int same = matches_photo(photos->output_path, &photos->input, label);
+    if (loaded || !freed || saved_planes)
+    {
+        fprintf(stderr, "FAIL %s: %s without buffers.\n", label, loaded || !freed ? "planes were loaded" : "planes were saved");
+        same = 0;
+    }
+    return same;
+}
+
+/**
+ * @brief Compares each level of a pyramid with 2x2 averages of the level above, repeating the last row and column.
+ * @return Returns 1 when every level matches, 0 otherwise.
+ */
+static int check_pyramid(const backend_photos *photos, const char *backend)
+{
+    char prefix[4200], path[4300], label[256];
+    snprintf(prefix, sizeof(prefix), "%s/level", photos->work);
+    int saved[2];
+    silence(saved);
+    bmp_file bmp = open_bmp(photos->input_path);
+    int written = bmp.photo != NULL ? build_pyramid(bmp, prefix, MAX_PYRAMID_LEVELS) : 0;
+    restore(saved);
+    if (bmp.photo != NULL)
+    {
+        close_bmp(bmp);
+    }
+
+    photo_pixels level = copy_photo(&photos->input);
+    int count = 0, same = 1;
+    while (count < MAX_PYRAMID_LEVELS && (level.width > 1 || level.height > 1))
+    {
+        photo_pixels next = new_photo((level.width + 1) / 2, (level.height + 1) / 2);
+        for (int h = 0; h < next.height; h++)
+        {
+            for (int w = 0; w < next.width; w++)
+            {
+                for (int c = 0; c < CHANNELS; c++)
+                {
+                    int sum = color_at(&level, 2 * w, 2 * h)[c] + color_at(&level, 2 * w + 1, 2 * h)[c] +
+                              color_at(&level, 2 * w, 2 * h + 1)[c] + color_at(&level, 2 * w + 1, 2 * h + 1)[c];
+                    color_at(&next, w, h)[c] = (sum + 2) >> 2;
+                }
+            }
+        }
+        free(level.pixels);
+        level = next;
+
+        snprintf(path, sizeof(path), "%s_%i.bmp", prefix, 2 << count);
+        snprintf(label, sizeof(label), "pyramid level %i %ix%i %s", count + 1, photos->input.width, photos->input.height, backend);
+        same &= matches_photo(path, &level, label);
+        unlink(path);
+        count++;
+    }
+    free(level.pixels);
+
+    if (written != count)
+    {
+        fprintf(stderr, "FAIL pyramid %ix%i %s: %i levels, expected %i.\n", photos->input.width, photos->input.height, backend, written, count);
+        same = 0;
+    }
+    return same;
+}
+
+/**
+ * @brief Builds a pyramid whose first level path is a link to the photo being read.
+ * @return Returns 1 when nothing is built and the photo is unchanged, 0 otherwise.
+ */
+static int check_pyramid_input(const backend_photos *photos, const char *backend)
+{
+    char prefix[4200], path[4300], label[256];
+    snprintf(prefix, sizeof(prefix), "%s/self", photos->work);
+    snprintf(path, sizeof(path), "%s_2.bmp", prefix);
+    snprintf(label, sizeof(label), "pyramid over its input %ix%i %s", photos->input.width, photos->input.height, backend);
+    if (symlink(photos->input_path, path) != 0)
+    {
+        fprintf(stderr, "FAIL %s: %s could not be linked.\n", label, path);
+        return 0;
+    }
+
+    int saved[2];
+    silence(saved);
+    bmp_file bmp = open_bmp(photos->input_path);
+    int written = bmp.photo != NULL ? build_pyramid(bmp, prefix, MAX_PYRAMID_LEVELS) : -1;
+    restore(saved);
+    if (bmp.photo != NULL)
+    {
+        close_bmp(bmp);
+    }
+    unlink(path);
+
+    int same = matches_photo(photos->input_path, &photos->input, label);
+    if (written != 0)
+    {
+        fprintf(stderr, "FAIL %s: %i levels, expected none.\n", label, written);
+        same = 0;
+    }
+    return same;
+}
+
+/****************************************/
+/*************** Headers ****************/
+/****************************************/
+/**
+ * A change to the bytes of a valid photo and the problem it causes
+ */
+typedef struct
+{
+    const char *name;
+    int field; // byte offset of the changed field, or -1 to only change the length
+    int value;
+    long length; // bytes of the file kept, -1 for all of them
+    enum header_problem problem;
+} header_case;
+
+static const header_case header_cases[] = {
+    {"valid", -1, 0, -1, HEADER_VALID},
+    {"empty", -1, 0, 0, HEADER_SHORT},
+    {"short", -1, 0, 30, HEADER_SHORT},
+    {"magic", 0, 'B' | 'X' << 8, -1, HEADER_MAGIC},
+    {"small dib", 14, 12, -1, HEADER_DIB_SIZE},
+    {"huge dib", 14, 0x7FFFFFFF, -1, HEADER_DIB_SIZE},
+    {"zero width", 18, 0, -1, HEADER_DIMENSIONS},
+    {"zero height", 22, 0, -1, HEADER_DIMENSIONS},
+    {"negative height", 22, -3, -1, HEADER_DIMENSIONS},
+    {"huge width", 18, 0x40000000, -1, HEADER_DIMENSIONS},
+    {"wide", 18, 0x10000000, -1, HEADER_TRUNCATED},
+    {"huge height", 22, 0x7FFFFFFF, -1, HEADER_TRUNCATED},
+    {"32 bpp", 28, 32, -1, HEADER_BPP},
+    {"compressed", 30, 1, -1, HEADER_COMPRESSION},
+    {"offset within headers", 10, 20, -1, HEADER_OFFSET},
+    {"offset past the end", 10, 0x7FFFFFFF, -1, HEADER_OFFSET},
+    {"truncated", -1, 0, HEADER_SIZE + 16 * 3 - 1, HEADER_TRUNCATED},
+};
+
+/**
+ * @brief The problem check_header finds in the bytes of a file, or HEADER_SHORT when there is no header.
+ */
+static enum header_problem problem_of(const unsigned char *bytes, long length)
+{
+    if (length < HEADER_SIZE)
+    {
+        return HEADER_SHORT;
+    }
+    bmp_header header;
+    decode_header(bytes, &header);
+    return check_header(header, length);
+}
+
+/**
+ * @brief Writes the bytes of a photo, opens it, and checks that open_bmp agrees with check_header.
+ * @details Photos are opened exactly when the header is valid or only of another color density,
+ *          and the rows of a valid photo read back the bytes that follow the pixel offset.
+ * @return Returns 1 when they agree, 0 otherwise.
+ */
+static int check_header_bytes(const char *path, const unsigned char *bytes, long length, enum header_problem problem, const char *name)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL || fwrite(bytes, 1, length, file) != (size_t)length)
+    {
+        fprintf(stderr, "FAIL header %s: the photo could not be written.\n", name);
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+        return 0;
+    }
+    fclose(file);
+
+    int saved[2];
+    silence(saved);
+    bmp_file bmp = open_bmp(path);
+    restore(saved);
+    int opened = bmp.photo != NULL, same = opened == (problem == HEADER_VALID || problem == HEADER_BPP);
+    if (!same)
+    {
+        fprintf(stderr, "FAIL header %s: %s by open_bmp with problem %s.\n", name, opened ? "opened" : "refused", header_problem_name(problem));
+    }
+
+    if (opened && problem == HEADER_VALID)
+    {
+        int stride = row_stride(bmp.header);
+        long long end = bmp.header.bitmap.offset + (long long)stride * bmp.header.dib.height;
+        unsigned char *rows = end <= length ? malloc((size_t)stride * bmp.header.dib.height) : NULL;
+        if (rows != NULL)
+        {
+            read_rows(bmp, 0, bmp.header.dib.height, rows);
+        }
+        if (rows == NULL || memcmp(rows, bytes + bmp.header.bitmap.offset, (size_t)stride * bmp.header.dib.height) != 0)
+        {
+            fprintf(stderr, "FAIL header %s: the rows of a valid photo do not lie within the file.\n", name);
+            same = 0;
+        }
+        free(rows);
+    }
+    if (opened)
+    {
+        close_bmp(bmp);
+    }
+    return same;
+}
+
+/**
+ * @brief Checks the malformed headers, then headers with random bytes altered or cut short.
+ * @return Returns the number of checks failed.
+ */
+static int check_headers(const char *work, unsigned *state, int *passed)
+{
+    char path[4200];
+    snprintf(path, sizeof(path), "%s/header.bmp", work);
+    photo_pixels base = random_photo(5, 3, state);
+    long base_length = HEADER_SIZE + (long)base.stride * base.height;
+    unsigned char *bytes = malloc(base_length);
+    int failed = 0;
+
+    for (size_t h = 0; h < sizeof(header_cases) / sizeof(header_cases[0]); h++)
+    {
+        const header_case *test = &header_cases[h];
+        encode_header(photo_header(base.width, base.height), bytes);
+        memcpy(bytes + HEADER_SIZE, base.pixels, base_length - HEADER_SIZE);
+        if (test->field >= 0)
+        {
+            int value = test->value;
+            memcpy(bytes + test->field, &value, sizeof(value));
+        }
+        long length = test->length < 0 ? base_length : test->length;
+
+        enum header_problem problem = problem_of(bytes, length);
+        int same = problem == test->problem && check_header_bytes(path, bytes, length, problem, test->name);
+        if (problem != test->problem)
+        {
+            fprintf(stderr, "FAIL header %s: check_header found %s, expected %s.\n", test->name, header_problem_name(problem), header_problem_name(test->problem));
+        }
+        failed += tally(same, passed);
+    }
+
+    // Random bytes of the header altered, and sometimes the file cut short
+    int agreed = 1;
+    for (int r = 0; r < RANDOM_HEADERS && agreed; r++)
+    {
+        encode_header(photo_header(base.width, base.height), bytes);
+        memcpy(bytes + HEADER_SIZE, base.pixels, base_length - HEADER_SIZE);
+        for (int changes = 1 + next_random(state) % 4; changes > 0; changes--)
+        {
+            bytes[next_random(state) % HEADER_SIZE] = next_random(state) & 0xFF;
+        }
+        long length = next_random(state) % 4 ? base_length : (long)(next_random(state) % base_length);
+
+        char name[64];
+        snprintf(name, sizeof(name), "random %i", r);
+        agreed = check_header_bytes(path, bytes, length, problem_of(bytes, length), name);
+    }
+    failed += tally(agreed, passed);
+
+    unlink(path);
+    free(bytes);
+    free(base.pixels);
+    return failed;
+}
+
+/****************************************/
+/***************** Main *****************/
+/****************************************/
+/**
+ * @brief Writes the photos of one size, then runs every check on one thread and on several.
+ * @return Returns the number of checks failed.
+ */
+static int check_size(int width, int height, unsigned *state, const char *work, int *passed)
+{
+    backend_photos photos;
+    snprintf(photos.work, sizeof(photos.work), "%s", work);
+    snprintf(photos.input_path, sizeof(photos.input_path), "%s/input.bmp", work);
+    snprintf(photos.other_path, sizeof(photos.other_path), "%s/other.bmp", work);
+    snprintf(photos.mark_path, sizeof(photos.mark_path), "%s/mark.bmp", work);
+    snprintf(photos.output_path, sizeof(photos.output_path), "%s/output.bmp", work);
+    photos.input = random_photo(width, height, state);
+    photos.other = random_photo(width, height, state);
+    photos.mark = random_photo(width / 2 + 1, height / 3 + 1, state);
+
+    int failed = 0;
+    int written = write_photo(photos.input_path, &photos.input) && write_photo(photos.other_path, &photos.other) &&
+                  write_photo(photos.mark_path, &photos.mark);
+    if (!written)
+    {
+        fprintf(stderr, "FAIL %ix%i: the photos could not be written.\n", width, height);
+        failed++;
+    }
+
+    // One band, then bands split across threads with halos between them
+    const char *threads[] = {"1", "8"};
+    for (int t = 0; t < 2 && written; t++)
+    {
+        char backend[64];
+        snprintf(backend, sizeof(backend), "%s, %s threads", SIMD_NAME, threads[t]);
+        setenv("STENOGRAPHY_THREADS", threads[t], 1);
+
+        for (size_t c = 0; c < sizeof(checks) / sizeof(checks[0]); c++)
+        {
+            failed += tally(run_check(&checks[c], &photos, backend), passed);
+        }
+        failed += tally(check_statistics(&photos, backend), passed);
+        failed += tally(check_pyramid(&photos, backend), passed);
+        failed += tally(check_pyramid_input(&photos, backend), passed);
+        failed += tally(check_planar_failure(&photos, backend), passed);
+    }
+
+    unlink(photos.input_path);
+    unlink(photos.other_path);
+    unlink(photos.mark_path);
+    unlink(photos.output_path);
+    free(photos.input.pixels);
+    free(photos.other.pixels);
+    free(photos.mark.pixels);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned seed = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : DEFAULT_SEED, state = seed;
+    char work[] = "/tmp/check_backends_XXXXXX";
+    if (mkdtemp(work) == NULL)
+    {
+        fprintf(stderr, "Could not create a directory for the photos.\n");
+        return 2;
+    }
+    prepare_kernels();
+
+    int passed = 0, failed = 0;
+    for (size_t s = 0; s < sizeof(fixed_sizes) / sizeof(fixed_sizes[0]); s++)
+    {
+        failed += check_size(fixed_sizes[s][0], fixed_sizes[s][1], &state, work, &passed);
+    }
+
+    // Odd widths leave 1 to 3 bytes of padding
+    for (int s = 0; s < RANDOM_SIZES; s++)
+    {
+        int width = 2 * (next_random(&state) % 48) + 1, height = 1 + next_random(&state) % 96;
+        failed += check_size(width, height, &state, work, &passed);
+    }
+    failed += check_headers(work, &state, &passed);
+    rmdir(work);
+
+    fprintf(stdout, "%i of %i %s backend checks passed with seed %u.\n", passed, passed + failed, SIMD_NAME, seed);
+    return failed != 0 || passed == 0;
+}
@@ -0,0 +1,273 @@
+/**
+ * @file check_daemon.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Checks the requests of the daemon against the reference photos written by tests/make_reference.py.
+ *
+ * The daemon listens on a socket of a temporary directory while each request is sent as a client would.
+ * Photos are copied to paths holding spaces, sent as tab separated requests, and their outputs
+ * compared byte for byte with <operation>_<width>x<height>.bmp.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "daemon.h"
+
+#define CONNECT_ATTEMPTS 500 // 10 ms apart, while the daemon starts listening
+
+static char socket_path[64]; // within the length of a socket address
+
+/****************************************/
+/**************** Files *****************/
+/****************************************/
+/**
+ * @brief Reads a whole file.
+ * @return Returns the bytes, freed by the caller, or NULL when the file cannot be read.
+ */
+static unsigned char *read_file(const char *path, long *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char *bytes = malloc(*size > 0 ? *size : 1);
+    if (bytes != NULL && fread(bytes, 1, *size, file) != (size_t)*size)
+    {
+        free(bytes);
+        bytes = NULL;
+    }
+    fclose(file);
+    return bytes;
+}
+
+/**
+ * @brief Copies a file.
+ * @return Returns 1 when copied, 0 otherwise.
+ */
+static int copy_file(const char *source, const char *destination)
+{
+    long size;
+    unsigned char *bytes = read_file(source, &size);
+    FILE *file = bytes != NULL ? fopen(destination, "wb") : NULL;
+    int copied = file != NULL && fwrite(bytes, 1, size, file) == (size_t)size;
+    if (file != NULL)
+    {
+        copied &= fclose(file) == 0;
+    }
+    free(bytes);
+    return copied;
+}
+
+/**
+ * @brief Compares a photo with its reference.
+ * @return Returns 1 when the files are identical, 0 otherwise.
+ */
+static int matches(const char *path, const char *reference)
+{
+    long length, expected_length;
+    unsigned char *bytes = read_file(path, &length);
+    unsigned char *expected = read_file(reference, &expected_length);
+    int same = bytes != NULL && expected != NULL && length == expected_length && memcmp(bytes, expected, length) == 0;
+    free(bytes);
+    free(expected);
+    return same;
+}
+
+/****************************************/
+/**************** Client ****************/
+/****************************************/
+static void *daemon_thread(void *arg)
+{
+    return (void *)(long)run_daemon(socket_path);
+}
+
+/**
+ * @brief Connects to the daemon, waiting for it to listen.
+ * @return Returns the connection, or -1 when the daemon never listened.
+ */
+static int connect_daemon(void)
+{
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strcpy(address.sun_path, socket_path);
+    struct timespec pause = {0, 10000000};
+
+    for (int attempt = 0; attempt < CONNECT_ATTEMPTS; attempt++)
+    {
+        int client = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (client < 0)
+        {
+            return -1;
+        }
+        if (connect(client, (struct sockaddr *)&address, sizeof(address)) == 0)
+        {
+            return client;
+        }
+        close(client);
+        nanosleep(&pause, NULL);
+    }
+    return -1;
+}
+
+/**
+ * @brief Sends a request to the daemon and reads its reply.
+ * @return Returns 1 when a reply was read, 0 otherwise.
+ */
+static int send_request(const char *request, char *answer, size_t size)
+{
+    int client = connect_daemon();
+    if (client < 0)
+    {
+        return 0;
+    }
+
+    size_t length = 0;
+    if (send(client, request, strlen(request), MSG_NOSIGNAL) == (ssize_t)strlen(request))
+    {
+        ssize_t received;
+        while (length < size - 1 && (received = recv(client, answer + length, size - 1 - length, 0)) > 0)
+        {
+            length += received;
+        }
+    }
+    answer[length] = '\0';
+    close(client);
+    return length > 0;
+}
+
+/****************************************/
+/**************** Checks ****************/
+/****************************************/
+/**
+ * @brief Counts a passed check.
+ * @return Returns 1 when the check failed, 0 otherwise.
+ */
+static int tally(int same, int *passed)
+{
+    if (same)
+    {
+        (*passed)++;
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Sends a request and checks whether the daemon accepted or refused it.
+ * @return Returns 1 when the reply starts as expected, 0 otherwise.
+ */
+static int check_reply(const char *name, const char *request, const char *expected)
+{
+    char answer[256];
+    if (!send_request(request, answer, sizeof(answer)))
+    {
+        fprintf(stderr, "FAIL %s: the daemon did not reply.\n", name);
+        return 0;
+    }
+    if (strncmp(answer, expected, strlen(expected)) != 0)
+    {
+        fprintf(stderr, "FAIL %s: replied %s", name, answer);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Runs an operation through the daemon and compares its output with the reference.
+ * @return Returns 1 when the daemon ran the job and the output matches, 0 otherwise.
+ */
+static int check_job(const char *name, const char *request, const char *output, const char *reference)
+{
+    if (!check_reply(name, request, "ok "))
+    {
+        return 0;
+    }
+    if (!matches(output, reference))
+    {
+        fprintf(stderr, "FAIL %s: %s does not match %s.\n", name, output, reference);
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <reference directory>\n", argv[0]);
+        return 2;
+    }
+
+    char work[] = "/tmp/check_daemon_XXXXXX";
+    if (mkdtemp(work) == NULL)
+    {
+        fprintf(stderr, "Could not create a directory for the outputs.\n");
+        return 2;
+    }
+
+    char source[4096], input[4096], plain[4096], output[4096], plain_output[4096], reference[4096];
+    snprintf(source, sizeof(source), "%s/input_5x4.bmp", argv[1]);
+    snprintf(input, sizeof(input), "%s/my photo.bmp", work);
+    snprintf(plain, sizeof(plain), "%s/photo.bmp", work);
+    snprintf(output, sizeof(output), "%s/my output.bmp", work);
+    snprintf(plain_output, sizeof(plain_output), "%s/output.bmp", work);
+    snprintf(socket_path, sizeof(socket_path), "%s/daemon.sock", work);
+    if (!copy_file(source, input) || !copy_file(source, plain))
+    {
+        fprintf(stderr, "%s not successfully copied.\n", source);
+        return 2;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, daemon_thread, NULL) != 0)
+    {
+        fprintf(stderr, "Could not start the daemon.\n");
+        return 2;
+    }
+
+    int passed = 0, failed = 0;
+    char request[3 * 4096 + 16];
+
+    // Tabs separate paths holding spaces
+    snprintf(request, sizeof(request), "%s\tinvert\t%s\n", input, output);
+    snprintf(reference, sizeof(reference), "%s/invert_5x4.bmp", argv[1]);
+    failed += tally(check_job("tab separated spaced paths", request, output, reference), &passed);
+
+    // Requests without tabs are still split at spaces
+    snprintf(request, sizeof(request), "%s grayscale %s\n", plain, plain_output);
+    snprintf(reference, sizeof(reference), "%s/grayscale_5x4.bmp", argv[1]);
+    failed += tally(check_job("space separated paths", request, plain_output, reference), &passed);
+
+    // A spaced path without tabs is more than three fields
+    snprintf(request, sizeof(request), "%s invert %s\n", input, output);
+    failed += tally(check_reply("space separated spaced paths", request, "error "), &passed);
+    snprintf(request, sizeof(request), "%s\tinvert\n", input);
+    failed += tally(check_reply("two fields", request, "error "), &passed);
+    snprintf(request, sizeof(request), "%s\tinvert\t%s\textra\n", input, output);
+    failed += tally(check_reply("four fields", request, "error "), &passed);
+
+    failed += tally(check_reply("quit", "quit\n", "ok"), &passed);
+    void *result;
+    pthread_join(thread, &result);
+    failed += tally(result == NULL, &passed);
+
+    unlink(input);
+    unlink(plain);
+    unlink(output);
+    unlink(plain_output);
+    rmdir(work);
+
+    fprintf(stdout, "%i of %i daemon checks passed.\n", passed, passed + failed);
+    return failed != 0;
+}
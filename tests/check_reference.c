@@ -0,0 +1,321 @@
+/**
+ * @file check_reference.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Checks each operation against the reference photos written by tests/make_reference.py.
+ *
+ * Every input_<width>x<height>.bmp of the reference directory is copied, altered by each
+ * operation, and compared byte for byte, padding included, with <operation>_<width>x<height>.bmp.
+ * The pipeline kernels are checked against the same references as the operations they replace.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "stenography.h"
+#include "pipeline.h"
+#include "color.h"
+
+#define TABLE_SAMPLES (1 << 22) // linear colors from 0 to 1 delinearized by both paths
+
+/**
+ * An operation and the reference photos it must reproduce
+ */
+typedef struct
+{
+    const char *name;      // name of the check
+    const char *reference; // start of the reference photo names
+    void (*apply)(bmp_file bmp, bmp_file hidden);
+} reference_check;
+
+/****************************************/
+/************** Operations **************/
+/****************************************/
+static void apply_reveal(bmp_file bmp, bmp_file hidden)
+{
+    reveal(bmp);
+}
+
+static void apply_peek(bmp_file bmp, bmp_file hidden)
+{
+    peek(bmp);
+}
+
+static void apply_hide(bmp_file bmp, bmp_file hidden)
+{
+    hide(bmp, hidden);
+}
+
+static void apply_invert(bmp_file bmp, bmp_file hidden)
+{
+    invert(bmp);
+}
+
+static void apply_grayscale(bmp_file bmp, bmp_file hidden)
+{
+    grayscale(bmp);
+}
+
+static void apply_hflip(bmp_file bmp, bmp_file hidden)
+{
+    hflip_image(bmp);
+}
+
+static void apply_mirror(bmp_file bmp, bmp_file hidden)
+{
+    mirror(bmp);
+}
+
+/**
+ * @brief Runs a chain of pipeline kernels over a photo.
+ */
+static void apply_chain(bmp_file bmp, const char *chain)
+{
+    pipeline_stage stages[MAX_STAGES];
+    int count = parse_pipeline(chain, stages);
+    if (count >= 0)
+    {
+        run_pipeline(bmp, stages, count);
+    }
+}
+
+static void apply_pipeline_reveal(bmp_file bmp, bmp_file hidden)
+{
+    apply_chain(bmp, "reveal");
+}
+
+static void apply_pipeline_invert(bmp_file bmp, bmp_file hidden)
+{
+    apply_chain(bmp, "invert");
+}
+
+static void apply_pipeline_grayscale(bmp_file bmp, bmp_file hidden)
+{
+    apply_chain(bmp, "grayscale");
+}
+
+static const reference_check checks[] = {
+    {"reveal", "reveal", apply_reveal},
+    {"peek", "peek", apply_peek},
+    {"hide", "hide", apply_hide},
+    {"invert", "invert", apply_invert},
+    {"grayscale", "grayscale", apply_grayscale},
+    {"hflip", "hflip", apply_hflip},
+    {"mirror", "mirror", apply_mirror},
+    {"pipeline reveal", "reveal", apply_pipeline_reveal},
+    {"pipeline invert", "invert", apply_pipeline_invert},
+    {"pipeline grayscale", "grayscale", apply_pipeline_grayscale},
+};
+
+/****************************************/
+/**************** Files *****************/
+/****************************************/
+/**
+ * @brief Reads a whole file.
+ * @return Returns the bytes, freed by the caller, or NULL when the file cannot be read.
+ */
+static unsigned char *read_file(const char *path, long *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char *bytes = malloc(*size > 0 ? *size : 1);
+    if (bytes != NULL && fread(bytes, 1, *size, file) != (size_t)*size)
+    {
+        free(bytes);
+        bytes = NULL;
+    }
+    fclose(file);
+    return bytes;
+}
+
+/**
+ * @brief Copies a file.
+ * @return Returns 1 when copied, 0 otherwise.
+ */
+static int copy_file(const char *source, const char *destination)
+{
+    long size;
+    unsigned char *bytes = read_file(source, &size);
+    FILE *file = bytes != NULL ? fopen(destination, "wb") : NULL;
+    int copied = file != NULL && fwrite(bytes, 1, size, file) == (size_t)size;
+    if (file != NULL)
+    {
+        copied &= fclose(file) == 0;
+    }
+    free(bytes);
+    return copied;
+}
+
+/**
+ * @brief Compares a photo with its reference, describing the first difference.
+ * @return Returns 1 when the files are identical, 0 otherwise.
+ */
+static int matches(const char *path, const char *reference, const char *check, const char *size)
+{
+    long length, expected_length;
+    unsigned char *bytes = read_file(path, &length);
+    unsigned char *expected = read_file(reference, &expected_length);
+    int same = bytes != NULL && expected != NULL && length == expected_length;
+
+    if (bytes == NULL || expected == NULL)
+    {
+        fprintf(stderr, "FAIL %s %s: %s could not be read.\n", check, size, bytes == NULL ? path : reference);
+    }
+    else if (length != expected_length)
+    {
+        fprintf(stderr, "FAIL %s %s: %ld bytes, expected %ld.\n", check, size, length, expected_length);
+    }
+    for (long i = 0; same && i < length; i++)
+    {
+        if (bytes[i] != expected[i])
+        {
+            fprintf(stderr, "FAIL %s %s: byte %ld is %i, expected %i.\n", check, size, i, bytes[i], expected[i]);
+            same = 0;
+        }
+    }
+
+    free(bytes);
+    free(expected);
+    return same;
+}
+
+/****************************************/
+/**************** Checks ****************/
+/****************************************/
+/**
+ * @brief Runs one operation over a copy of an input and compares it with its reference.
+ * @return Returns 1 when the output matches the reference, 0 otherwise.
+ */
+static int run_check(const reference_check *check, const char *directory, const char *work, const char *size)
+{
+    char input[4096], hidden[4096], reference[4096], output[4096], hidden_copy[4096];
+    snprintf(input, sizeof(input), "%s/input_%s", directory, size);
+    snprintf(hidden, sizeof(hidden), "%s/hidden_%s", directory, size);
+    snprintf(reference, sizeof(reference), "%s/%s_%s", directory, check->reference, size);
+    snprintf(output, sizeof(output), "%s/output.bmp", work);
+    snprintf(hidden_copy, sizeof(hidden_copy), "%s/hidden.bmp", work);
+
+    if (!copy_file(input, output) || !copy_file(hidden, hidden_copy))
+    {
+        fprintf(stderr, "FAIL %s %s: the inputs could not be copied.\n", check->name, size);
+        return 0;
+    }
+
+    bmp_file bmp = open_bmp(output);
+    bmp_file other = open_bmp(hidden_copy);
+    if (bmp.photo == NULL || other.photo == NULL)
+    {
+        fprintf(stderr, "FAIL %s %s: the inputs could not be opened.\n", check->name, size);
+        if (bmp.photo != NULL)
+        {
+            close_bmp(bmp);
+        }
+        if (other.photo != NULL)
+        {
+            close_bmp(other);
+        }
+        return 0;
+    }
+
+    check->apply(bmp, other);
+    close_bmp(bmp);
+    close_bmp(other);
+    return matches(output, reference, check->name, size);
+}
+
+/**
+ * @brief Checks that delinearizing by table matches delinearize() from 0 to 1, white included.
+ * @return Returns 1 when every sample matches, 0 otherwise.
+ */
+static int check_delinearize_table(void)
+{
+    prepare_color_tables();
+    for (int i = 0; i <= TABLE_SAMPLES; i++)
+    {
+        double color_lin = (double)i / TABLE_SAMPLES;
+        if (table_delinearize(color_lin) != delinearize(color_lin))
+        {
+            fprintf(stderr, "FAIL delinearize table: %.17g is %i, expected %i.\n",
+                    color_lin, table_delinearize(color_lin), delinearize(color_lin));
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <reference directory>\n", argv[0]);
+        return 2;
+    }
+
+    struct dirent **entries;
+    int count = scandir(argv[1], &entries, NULL, alphasort);
+    if (count < 0)
+    {
+        fprintf(stderr, "%s not successfully opened.\n", argv[1]);
+        return 2;
+    }
+
+    char work[] = "/tmp/check_reference_XXXXXX";
+    if (mkdtemp(work) == NULL)
+    {
+        fprintf(stderr, "Could not create a directory for the outputs.\n");
+        return 2;
+    }
+
+    // Each input is named input_<width>x<height>.bmp, its references share the size
+    int passed = 0, failed = 0;
+    for (int e = 0; e < count; e++)
+    {
+        const char *name = entries[e]->d_name;
+        if (strncmp(name, "input_", 6) == 0)
+        {
+            for (size_t c = 0; c < sizeof(checks) / sizeof(checks[0]); c++)
+            {
+                if (run_check(&checks[c], argv[1], work, name + 6))
+                {
+                    passed++;
+                }
+                else
+                {
+                    failed++;
+                }
+            }
+        }
+        free(entries[e]);
+    }
+    free(entries);
+
+    // The grayscale kernel delinearizes by table, grayscale() with delinearize()
+    if (check_delinearize_table())
+    {
+        passed++;
+    }
+    else
+    {
+        failed++;
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/output.bmp", work);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/hidden.bmp", work);
+    unlink(path);
+    rmdir(work);
+
+    fprintf(stdout, "%i of %i reference checks passed.\n", passed, passed + failed);
+    return failed != 0 || passed == 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file fuzz_open_bmp.c
+ * @author Jacob Sharp
+ * @copyright MIT License
+ *
+ * @brief Fuzzes open_bmp and check_header with arbitrary file contents.
+ *
+ * Built with -DFUZZING and -fsanitize=fuzzer by `make fuzz`, libFuzzer calls LLVMFuzzerTestOneInput.
+ * Built without, main replays each file given on the command line, as `make test` does.
+ * Any input where open_bmp and check_header disagree, or where the rows of a valid photo
+ * are not the bytes after its pixel offset, aborts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stenography.h"
+
+static char input_path[] = "/tmp/fuzz_open_bmp_XXXXXX";
+static int input_file = -1;
+
+static void remove_input(void)
+{
+    unlink(input_path);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    // Every input is written to the same file, as open_bmp reads a path
+    if (input_file < 0)
+    {
+        input_file = mkstemp(input_path);
+        if (input_file < 0)
+        {
+            fprintf(stderr, "Could not create a file for the inputs.\n");
+            abort();
+        }
+        atexit(remove_input);
+    }
+    if (ftruncate(input_file, 0) != 0 || pwrite(input_file, data, size, 0) != (ssize_t)size)
+    {
+        fprintf(stderr, "Could not write the input.\n");
+        abort();
+    }
+
+    // Photos are opened exactly when the header is valid or only of another color density
+    enum header_problem problem = HEADER_SHORT;
+    bmp_header header;
+    if (size >= HEADER_SIZE)
+    {
+        decode_header(data, &header);
+        problem = check_header(header, size);
+    }
+    bmp_file bmp = open_bmp(input_path);
+    if ((bmp.photo != NULL) != (problem == HEADER_VALID || problem == HEADER_BPP))
+    {
+        fprintf(stderr, "open_bmp %s a photo with problem %s.\n", bmp.photo != NULL ? "opened" : "refused", header_problem_name(problem));
+        abort();
+    }
+    if (bmp.photo == NULL)
+    {
+        return 0;
+    }
+
+    // Every row of a valid photo lies within the file
+    if (problem == HEADER_VALID)
+    {
+        size_t pixels = (size_t)row_stride(bmp.header) * bmp.header.dib.height;
+        uint8_t *rows = malloc(pixels > 0 ? pixels : 1);
+        if (rows != NULL)
+        {
+            read_rows(bmp, 0, bmp.header.dib.height, rows);
+            if (bmp.header.bitmap.offset + pixels > size || memcmp(rows, data + bmp.header.bitmap.offset, pixels) != 0)
+            {
+                fprintf(stderr, "The rows of a valid photo do not lie within the file.\n");
+                abort();
+            }
+            free(rows);
+        }
+    }
+    close_bmp(bmp);
+    return 0;
+}
+
+#ifndef FUZZING
+int main(int argc, char **argv)
+{
+    int replayed = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == NULL)
+        {
+            fprintf(stderr, "%s not successfully opened.\n", argv[i]);
+            return 2;
+        }
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        uint8_t *data = malloc(size > 0 ? size : 1);
+        if (data == NULL || fread(data, 1, size, file) != (size_t)size)
+        {
+            fprintf(stderr, "%s not successfully read.\n", argv[i]);
+            return 2;
+        }
+        fclose(file);
+
+        LLVMFuzzerTestOneInput(data, size);
+        free(data);
+        replayed++;
+    }
+
+    fprintf(stdout, "%i inputs replayed through open_bmp and check_header.\n", replayed);
+    return 0;
+}
+#endif
@@ -0,0 +1,140 @@
+# author: Jacob Sharp
+#
+# Writes the reference photos in tests/reference that check_reference compares the C operations against.
+# Every operation is written again here a pixel at a time, straight from its definition, so the
+# references do not depend on the C code they check. Run from the repository root:
+#     python3 tests/make_reference.py
+
+import os
+import struct
+
+REFERENCE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'reference')
+
+# Odd widths cover every amount of row padding, 1x1 and single rows and columns the edges
+SIZES = [(1, 1), (2, 3), (3, 2), (5, 4), (6, 3), (7, 5), (1, 9), (9, 1), (16, 16), (33, 7)]
+
+
+def row_stride(width):
+    return (3 * width + 3) & ~3
+
+
+def write_bmp(path, width, height, rows):
+    """Writes rows of (b, g, r) pixels, bottom row first, as a 24 bpp photo with zeroed padding."""
+    stride = row_stride(width)
+    pixels = bytearray()
+    for row in rows:
+        for pixel in row:
+            pixels += bytes(pixel)
+        pixels += bytes(stride - 3 * width)
+
+    header = struct.pack('<2sIHHI', b'BM', 54 + len(pixels), 0, 0, 54)
+    header += struct.pack('<IiiHHIIiiII', 40, width, height, 1, 24, 0, len(pixels), 2835, 2835, 0, 0)
+    with open(path, 'wb') as photo:
+        photo.write(header + pixels)
+
+
+def random_rows(width, height, seed):
+    """Deterministic colors, starting with white and black so both ends of each channel are covered."""
+    state = seed
+    rows = []
+    for h in range(height):
+        row = []
+        for w in range(width):
+            pixel = []
+            for c in range(3):
+                state = (state * 1103515245 + 12345) & 0x7FFFFFFF
+                pixel.append(state >> 16 & 0xFF)
+            row.append(tuple(pixel))
+        rows.append(row)
+
+    rows[0][0] = (255, 255, 255)
+    if width * height > 1:
+        flat = [pixel for row in rows for pixel in row]
+        flat[1] = (0, 0, 0)
+        rows = [flat[h * width:(h + 1) * width] for h in range(height)]
+    return rows
+
+
+def map_colors(rows, function):
+    return [[tuple(function(color) for color in pixel) for pixel in row] for row in rows]
+
+
+def reveal(rows):
+    return map_colors(rows, lambda color: (color << 4 | color >> 4) & 0xFF)
+
+
+def hide(host, hidden):
+    return [[tuple((a & 0xF0) | b >> 4 for a, b in zip(pixel, other)) for pixel, other in zip(row, other_row)]
+            for row, other_row in zip(host, hidden)]
+
+
+def invert(rows):
+    return map_colors(rows, lambda color: ~color & 0xFF)
+
+
+def linearize(color):
+    color_lin = color / 255.0
+    if color_lin <= 0.04045:
+        return color_lin / 12.92
+    return ((color_lin + 0.055) / 1.055) ** 2.4
+
+
+def delinearize(color_lin):
+    if color_lin <= 0.0031308:
+        color_lin *= 12.92
+    else:
+        color_lin = 1.055 * color_lin ** (1 / 2.4) - 0.055
+    return int(color_lin * 255)
+
+
+def grayscale(rows):
+    result = []
+    for row in rows:
+        gray_row = []
+        for b, g, r in row:
+            luminance = 0.2126 * linearize(r) + 0.7152 * linearize(g) + 0.0722 * linearize(b)
+            gray = delinearize(luminance)
+            gray_row.append((gray, gray, gray))
+        result.append(gray_row)
+    return result
+
+
+def hflip(rows):
+    return [row[::-1] for row in rows]
+
+
+def mirror(rows):
+    result = []
+    for row in rows:
+        row = list(row)
+        for w in range(len(row) // 2):
+            row[len(row) - w - 1] = row[w]
+        result.append(row)
+    return result
+
+
+def main():
+    os.makedirs(REFERENCE_DIR, exist_ok=True)
+    for width, height in SIZES:
+        size = f'{width}x{height}'
+        rows = random_rows(width, height, width * 1000 + height)
+        hidden = random_rows(width, height, width * 1000 + height + 7919)
+
+        outputs = {
+            'input': rows,
+            'hidden': hidden,
+            'reveal': reveal(rows),
+            'peek': reveal(rows),
+            'hide': hide(rows, hidden),
+            'invert': invert(rows),
+            'grayscale': grayscale(rows),
+            'hflip': hflip(rows),
+            'mirror': mirror(rows),
+        }
+        for name, output in outputs.items():
+            write_bmp(os.path.join(REFERENCE_DIR, f'{name}_{size}.bmp'), width, height, output)
+    print(f'Reference photos written to {REFERENCE_DIR}')
+
+
+if __name__ == '__main__':
+    main()